@@ -0,0 +1,29 @@
+--compares echo through the classic C API closure (console.echo) with the one
+--bound through LuaJIT's FFI (see luaconsoleffi.lua), run it from the console
+--with dofile('examples/echobench.lua'), results are echoed at the end
+local ffiecho = dofile('luaconsoleffi.lua')
+local count = 200000
+
+local function bench(f)
+    local start = os.clock()
+    for i = 1, count do
+        f('benchmark line')
+    end
+    return os.clock() - start
+end
+
+local results = {}
+results[#results + 1] = {'classic', bench(console.echo)}
+if ffiecho then
+    results[#results + 1] = {'ffi', bench(ffiecho)}
+else
+    results[#results + 1] = {'ffi', nil}
+end
+
+for _, r in ipairs(results) do
+    if r[2] then
+        console.echo(string.format('%-8s %8.1f ns per echo (%d echoes)', r[1], r[2] * 1e9 / count, count))
+    else
+        console.echo(string.format('%-8s not available (needs LuaJIT and exported blua_echo)', r[1]))
+    end
+end
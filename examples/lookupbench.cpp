@@ -0,0 +1,76 @@
+#include <lua.hpp>
+#include <LuaConsole/LuaConsoleModel.hpp>
+#include <cstdio>
+
+//microbenchmark of the two ways host C functions can find the console:
+//getFromRegistry (works in any function) and getFromUpvalue (only in closures
+//pushed with pushClosure), needs no SFML, build it with the model sources and
+//lua and run it, it prints how long a call from lua takes with each of them
+
+//count calls that found the console, so the lookups can't be optimized out
+static unsigned long found = 0u;
+
+int bench_viaRegistry(lua_State * L)
+{
+    if(blua::LuaConsoleModel::getFromRegistry(L))
+        ++found;
+
+    return 0;
+}
+
+int bench_viaUpvalue(lua_State * L)
+{
+    if(blua::LuaConsoleModel::getFromUpvalue(L))
+        ++found;
+
+    return 0;
+}
+
+//call global function name count times from a lua loop, returns seconds taken
+double timeCalls(lua_State * L, const char * name, int count)
+{
+    lua_getglobal(L, "timecalls");
+    lua_getglobal(L, name);
+    lua_pushinteger(L, count);
+    if(lua_pcall(L, 2, 1, 0) != 0)
+    {
+        std::printf("error: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return 0.0;
+    }
+
+    const double ret = lua_tonumber(L, -1);
+    lua_pop(L, 1);
+    return ret;
+}
+
+int main()
+{
+    lua_State * L = luaL_newstate();
+    luaL_openlibs(L);
+
+    blua::LuaConsoleModel model(blua::ECO_NONE);
+    model.setL(L);
+
+    lua_pushcfunction(L, &bench_viaRegistry);
+    lua_setglobal(L, "viaregistry");
+    model.pushClosure(&bench_viaUpvalue);
+    lua_setglobal(L, "viaupvalue");
+
+    //the loop itself is timed in lua so both use the exact same loop
+    luaL_dostring(L,
+        "function timecalls(f, count)\n"
+        "    local start = os.clock()\n"
+        "    for i = 1, count do f() end\n"
+        "    return os.clock() - start\n"
+        "end\n");
+
+    const int count = 5000000;
+    const double registry = timeCalls(L, "viaregistry", count);
+    const double upvalue = timeCalls(L, "viaupvalue", count);
+    std::printf("getFromRegistry %6.1f ns per call\n", registry * 1e9 / count);
+    std::printf("getFromUpvalue  %6.1f ns per call\n", upvalue * 1e9 / count);
+    std::printf("(found the console %lu times out of %d)\n", found, 2 * count);
+
+    lua_close(L);
+}
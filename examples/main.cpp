@@ -1,6 +1,7 @@
 #include <SFML/Graphics.hpp>
 #include <lua.hpp>
 #include <LuaConsole/LuaConsoleModel.hpp>
+#include <LuaConsole/LuaConsoleAllocator.hpp>
 #include <LuaConsole/LuaSFMLConsoleView.hpp>
 #include <LuaConsole/LuaSFMLConsoleInput.hpp>
 #include <cstdlib>
@@ -38,8 +39,9 @@ int demo_rainbowEcho(lua_State * L)
     std::size_t len;
     const char * msg = luaL_checklstring(L, 1, &len);
 
-    //get the model from the registry
-    blua::LuaConsoleModel * model = blua::LuaConsoleModel::getFromRegistry(L);
+    //get the model from the upvalue that pushClosure gave this function, this
+    //is much cheaper than getFromRegistry, which works in any function
+    blua::LuaConsoleModel * model = blua::LuaConsoleModel::getFromUpvalue(L);
 
     //check, since it might be null if it was deleted before this lua state
     if(model)
@@ -61,8 +63,8 @@ int demo_setTitle(lua_State * L)
 {
     const char * title = luaL_checkstring(L, 1);
 
-    //get the model from the registry
-    blua::LuaConsoleModel * model = blua::LuaConsoleModel::getFromRegistry(L);
+    //get the model from the upvalue
+    blua::LuaConsoleModel * model = blua::LuaConsoleModel::getFromUpvalue(L);
 
     //check, since it might be null if it was deleted before this lua state
     if(model)
@@ -78,7 +80,7 @@ int demo_echoColored(lua_State * L)
     const char * msg = luaL_checkstring(L, 1);
     unsigned color = static_cast<unsigned>(luaL_checknumber(L, 2)); //no check unsigned in 5.1/Jit
 
-    blua::LuaConsoleModel * model = blua::LuaConsoleModel::getFromRegistry(L);
+    blua::LuaConsoleModel * model = blua::LuaConsoleModel::getFromUpvalue(L);
     if(model)
         model->echoColored(msg, color);
 
@@ -97,7 +99,7 @@ int demo_setConsoleColor(lua_State * L)
     const int opt = luaL_checkoption(L, 1, 0x0, kColorNames);
     unsigned color = static_cast<unsigned>(luaL_checknumber(L, 2)); //no check unsigned in 5.1/Jit
 
-    blua::LuaConsoleModel * model = blua::LuaConsoleModel::getFromRegistry(L);
+    blua::LuaConsoleModel * model = blua::LuaConsoleModel::getFromUpvalue(L);
     if(model)
         model->setColor(static_cast<blua::ECONSOLE_COLOR>(opt), color);
 
@@ -112,16 +114,17 @@ const luaL_Reg demoReg[] = {
     {0x0, 0x0}
 };
 
-void openDemo(lua_State * L)
+void openDemo(lua_State * L, blua::LuaConsoleModel * model)
 {
     lua_newtable(L);
     //we do reg manually because
     //lua 5.2 deprecated register and 5.1 doesnt have setfuncs yet
+    //model pushes each function as closure that can get the model with getFromUpvalue
     int iter = 0;
     while(demoReg[iter].name)
     {
         lua_pushstring(L, demoReg[iter].name);
-        lua_pushcfunction(L, demoReg[iter].func);
+        model->pushClosure(demoReg[iter].func);
         lua_settable(L, -3);
         ++iter;
     }
@@ -135,10 +138,11 @@ int main()
     sf::RenderWindow app(sf::VideoMode(890u, 520u), "LuaConsole");
     app.setFramerateLimit(30u);
 
-    //open our state, as usual, open demo table in it too
-    lua_State * L = luaL_newstate();
+    //open our state, with console's allocator so we can see and cap how much
+    //memory it takes, the allocator has to outlive the state
+    blua::LuaConsoleAllocator allocator;
+    lua_State * L = allocator.newState();
     luaL_openlibs(L);
-    openDemo(L);
 
     //create our model
     blua::LuaConsoleModel model;
@@ -147,6 +151,12 @@ int main()
     //on each attempt to write or complete code, telling you you forgot to set it
     model.setL(L);
 
+    //a runaway command now gets a lua memory error after taking 256MB more
+    model.setCommandMemoryLimit(256u * 1024u * 1024u);
+
+    //open demo table, now that model is attached it can make closures for it
+    openDemo(L, &model);
+
     //create the input which will filter and translate sf::Event s
     //into calls to model api functions that move the cursor, type characters etc.
     blua::LuaSFMLConsoleInput input(&model);
@@ -172,6 +182,10 @@ int main()
         }
         app.clear();
 
+        //echo complete lines that were printed outside of console commands,
+        //only matters if output is redirected (see setRedirectOutput)
+        model.flushOutput();
+
         //pull all changes of characters, colors, etc. from the model
         //and get ready to render them (or not, if console is hidden)
         view.geoRebuild(&model);
@@ -179,6 +193,10 @@ int main()
         //draw the view with usual syntax, since it inherits from sf::Drawable
         app.draw(view);
         app.display();
+
+        //collect garbage for up to 1 ms now that the frame is done, so it
+        //doesn't pause the next one as much, '--gc' in console shows stats
+        model.idle(0.001);
     }
     lua_close(L);
 }
@@ -0,0 +1,91 @@
+#ifndef LUACONSOLEALLOCATOR_HPP
+#define	LUACONSOLEALLOCATOR_HPP
+
+#include <cstddef>
+#include <vector>
+
+struct lua_State;
+
+namespace blua {
+
+//lua allocator (lua_Alloc) to create a state with, blocks of up to 256 bytes
+//(so most strings, tables, closures and upvalues lua makes all the time) come
+//from free lists of 16 size classes carved out of 16KB pages, bigger ones
+//from realloc and free, it counts live bytes, blocks and allocations and can
+//cap live bytes, then allocations that would go over the cap fail and lua
+//raises a memory error (5.2 and 5.3 try an emergency collection first)
+//
+//it's not thread safe so use one per state, it has to outlive the state and
+//pages only go back to the system when it's destroyed, LuaConsoleModel finds
+//it with lua_getallocf, see setCommandMemoryLimit, 64 bit LuaJIT without
+//GC64 doesn't allow custom allocators at all, newState returns null there
+
+class LuaConsoleAllocator
+{
+public:
+    LuaConsoleAllocator();
+
+    //frees all pages, state made with this allocator must be closed by now
+    ~LuaConsoleAllocator();
+
+    //the lua_Alloc function, ud must be a pointer to LuaConsoleAllocator
+    static void * alloc(void * ud, void * ptr, std::size_t osize, std::size_t nsize);
+
+    //create new state using this allocator, same as lua_newstate(&alloc, this)
+    lua_State * newState();
+
+    //set most bytes that can be live at once, 0 means no cap and is the
+    //default, lowering it below live bytes doesn't free anything, just makes
+    //all growing allocations fail until enough gets freed
+    void setLimit(std::size_t bytes);
+
+    //get most bytes that can be live at once, 0 if there's no cap
+    std::size_t getLimit() const;
+
+    //get how many bytes lua holds right now, as lua asked for them
+    std::size_t getLiveBytes() const;
+
+    //get most bytes live at once since construction or last resetPeak
+    std::size_t getPeakBytes() const;
+
+    //set peak bytes to live bytes
+    void resetPeak();
+
+    //get how many blocks lua holds right now
+    std::size_t getLiveBlocks() const;
+
+    //get how many blocks were ever allocated and freed, a realloc is neither
+    std::size_t getAllocationCount() const;
+    std::size_t getFreeCount() const;
+
+    //get how many allocations failed due to the cap (or system running out)
+    std::size_t getFailedCount() const;
+
+    //get how many bytes are in pages of size class pools, used or not
+    std::size_t getPooledBytes() const;
+
+private:
+    //delete copy and assignment to forbid copying (state has our pointer)
+    LuaConsoleAllocator(const LuaConsoleAllocator& other);
+    LuaConsoleAllocator& operator=(const LuaConsoleAllocator& other);
+
+    void * allocate(std::size_t size);
+    void deallocate(void * ptr, std::size_t size);
+    void * reallocate(void * ptr, std::size_t osize, std::size_t nsize);
+    bool refill(std::size_t sizeclass);
+
+    void * m_free[16]; //free lists of size classes of 16, 32, ... 256 bytes
+    std::vector<char*> m_pages; //all pages of the pools
+    std::size_t m_limit; //most live bytes allowed, 0 if no limit
+    std::size_t m_live; //bytes lua holds now
+    std::size_t m_peak; //most bytes lua held at once
+    std::size_t m_allocs; //blocks allocated ever
+    std::size_t m_frees; //blocks freed ever
+    std::size_t m_failed; //allocations failed ever
+
+};
+
+} //blua
+
+#endif	/* LUACONSOLEALLOCATOR_HPP */
+
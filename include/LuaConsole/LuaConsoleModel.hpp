@@ -10,6 +10,26 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <cstdarg>
+
+//rvalue and string_view echo overloads, MSVC only reports the real standard
+//in _MSVC_LANG unless /Zc:__cplusplus is given
+#if __cplusplus >= 201103L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201103L)
+#define BLA_HAS_RVALUE_REFERENCES
+#endif
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define BLA_HAS_STRING_VIEW
+#include <string_view>
+#endif
+
+//functions for LuaJIT's FFI have to be exported from the program to be found
+#ifdef _WIN32
+#define BLA_EXPORT __declspec(dllexport)
+#else
+#define BLA_EXPORT __attribute__((visibility("default")))
+#endif
 
 #include <LuaConsole/LuaPointerOwner.hpp>
 
@@ -23,6 +43,9 @@ namespace blua {
 class LuaConsoleModel;
 typedef void (*CallbackFunc)(LuaConsoleModel*, void*);
 
+//same as lua_CFunction, so this header doesn't need to include lua
+typedef int (*LuaCFunction)(lua_State *);
+
 
 //type used to pass color of lines, both internally and in one of public echo functions
 typedef std::basic_string<unsigned> ColorString;
@@ -30,19 +53,76 @@ typedef std::basic_string<unsigned> ColorString;
 
 namespace priv {
 
+class HistoryIndex;
+class HistoryTrie;
+class HistoryJournal;
+class ColdScrollback;
+class ScrollbackFile;
+class Inspector;
+class OutputCapture;
+class Profiler;
+
 //internal structure to hold line of text and line of assigned colors
 
 class ColoredLine
 {
 public:
+    ColoredLine() : Repeats(0u), Pinned(0x0), PinnedSize(0u) { }
+
     std::string Text;
     ColorString Color;
+    std::size_t Repeats; //how many more times line was echoed right after itself
+    const char * Pinned; //if not null, text is in a lua string pinned in registry, not in Text
+    std::size_t PinnedSize; //length of pinned text, Color then has just one color for all of it
 
     void resizeColorToFitText(unsigned fill)
     {
         Color.resize(Text.size(), fill);
     }
 
+    //text of the line, pinned or not
+    const char * getText() const
+    {
+        return Pinned?Pinned:Text.data();
+    }
+
+    //length of the line, pinned or not
+    std::size_t getSize() const
+    {
+        return Pinned?PinnedSize:Text.size();
+    }
+
+    //color of i-th char, pinned or not
+    unsigned getColor(std::size_t i) const
+    {
+        return Pinned?Color[0]:Color[i];
+    }
+
+    //copy pinned text into the line, so it no longer needs the lua string
+    void unpin()
+    {
+        if(!Pinned)
+            return;
+
+        Text.assign(Pinned, PinnedSize);
+        Color.resize(PinnedSize, Color[0]);
+        Pinned = 0x0;
+        PinnedSize = 0u;
+    }
+
+};
+
+//position of a --grep match in scrollback, line is counted from the first
+//wide line ever echoed so it stays the same as old lines are dropped, or it's
+//a line of the scrollback file archive, these all go before the others
+
+class ScrollbackMatch
+{
+public:
+    bool Archived;
+    std::size_t Line;
+    std::size_t Start;
+
 };
 
 } //priv
@@ -64,10 +144,13 @@ enum ECONSOLE_OPTION
     ECO_HISTORY = 1, //load and save history in plaintext file - luaconsolehistory.txt
     ECO_INIT = 2, //load init file - luaconsoleinit.lua
     ECO_START_VISIBLE = 4, //start visible, this will likely get overwritten by init and so on
+    ECO_HISTORY_JOURNAL = 8, //with ECO_HISTORY, append each line to history file on enter instead of rewriting it at exit, see openHistoryJournal
+    ECO_SCROLLBACK_FILE = 16, //keep scrollback across runs in luaconsolescrollback.bin (and .bin.idx), see openScrollbackFile
+    ECO_REDIRECT_OUTPUT = 32, //make print, io.write and io.stdout:write of attached state write to console, see setRedirectOutput
 
 
     //keep last:
-    ECO_DEFAULT = 7, //do all of these helpful things above
+    ECO_DEFAULT = 7, //do all of these helpful things above, except for the journal and scrollback file
     ECO_NONE = 0 //do none of the helpful things, ALL is up to user now
 };
 
@@ -87,11 +170,33 @@ enum ECONSOLE_COLOR
     ECC_CURSOR = 8, //color of the cursor, default cyan
     ECC_EVAL = 9, //color of evals, default darkgrey
     ECC_HISTORY = 10, //color of history in comment command, default dark golden rod (0xb8860bff)
+    ECC_SUGGESTION = 11, //color of history suggestion after the prompt line, default grey (0x808080ff)
+    ECC_MATCH = 12, //color of text found by grepScrollback, default magenta (0xff00ffff)
+    ECC_WARNING = 13, //color of ECS_WARNING messages of echoChannel, default orange (0xffa500ff)
+    ECC_STATS = 14, //color of stats shown after each command, default dim grey (0x696969ff)
 
     ECONSOLE_COLOR_COUNT //count, keep last
 };
 
 
+//severities of messages echoed to channels, see echoChannel
+
+enum ECONSOLE_SEVERITY
+{
+    ECS_TRACE = 0, //in ECC_EVAL color
+    ECS_DEBUG = 1, //in ECC_EVAL color
+    ECS_INFO = 2, //in ECC_ECHO color
+    ECS_WARNING = 3, //in ECC_WARNING color
+    ECS_ERROR = 4, //in ECC_ERROR color
+    ECS_OFF = 5, //as lowest severity of a channel, turns it off
+
+    ECONSOLE_SEVERITY_COUNT //count, keep last
+};
+
+//how many channels there are for echoChannel, 0 to kChannelCount - 1
+const unsigned kChannelCount = 32u;
+
+
 //types of console callbacks
 
 enum ECALLBACK_TYPE
@@ -120,10 +225,26 @@ enum ELINE_PARSE_RESULT
     ELPR_OK = 0, //it parsed and ran
     ELPR_MORE, //it parsed but it's not a complete chunk yet
     ELPR_PARSE_ERROR, //it didn't parse
-    ELPR_RUNTIME_ERROR, //it parsed but didn't run
+    ELPR_RUNTIME_ERROR, //it parsed but didn't run, or ran out of memory compiling
     ELPR_NO_LUA //lua state ptr is not set
 };
 
+//metrics recorded for each command, see getCommandHistogram
+
+enum ECOMMAND_METRIC
+{
+    ECM_COMPILE = 0, //seconds it took to compile the chunk
+    ECM_WALL = 1, //seconds it took to run it
+    ECM_CPU = 2, //seconds of cpu time the thread used while it ran
+    ECM_MEMORY = 3, //bytes lua memory grew by (negative if it shrunk), per lua_gc count
+    ECM_GC_CYCLES = 4, //garbage collection cycles that finished while it ran
+
+    ECOMMAND_METRIC_COUNT //count, keep last
+};
+
+//how many buckets each histogram of command metrics has
+const unsigned kStatsBucketCount = 40u;
+
 //a single UTF-32 character* in console, with its' color
 //*so far it can only be an ascii char but this might change
 
@@ -135,6 +256,55 @@ public:
 
 };
 
+//run of chars of a line that are all in one color, see echoSpans
+
+class ColorSpan
+{
+public:
+    std::size_t Start; //index of first char, from 0
+    std::size_t Length;
+    unsigned Color;
+
+};
+
+//metrics of one command, indexed by ECOMMAND_METRIC
+
+class CommandStats
+{
+public:
+    double Values[ECOMMAND_METRIC_COUNT];
+
+};
+
+//aggregate of one metric over many commands, bucket 0 counts values under 1
+//(and negative ones), bucket i counts values from 2^(i-1) to 2^i and the last
+//one all bigger ones, times are counted in microseconds there
+
+class StatsHistogram
+{
+public:
+    std::size_t Count;
+    double Sum;
+    double Min;
+    double Max;
+    std::size_t Buckets[kStatsBucketCount];
+
+};
+
+//stats of collecting garbage in idle time, see LuaConsoleModel::idle
+
+class IdleGcStats
+{
+public:
+    std::size_t Calls; //how many times idle was called
+    std::size_t Cycles; //collection cycles idle finished
+    std::size_t OtherCycles; //cycles finished outside idle, by automatic collector or collectgarbage
+    double LastSeconds; //time last idle call spent collecting
+    double MaxOverrun; //most seconds an idle call went over its' budget
+    StatsHistogram Steps; //seconds each collector step took, in microsecond buckets
+
+};
+
 class LuaConsoleModel
 {
 public:
@@ -146,6 +316,20 @@ public:
     //as above, but lua errors instead of returning null
     static LuaConsoleModel * checkFromRegistry(lua_State * L);
 
+    //get the console of currently running C closure that was pushed with
+    //pushClosure, might return null, this is a single upvalue lookup so it's
+    //much cheaper than getFromRegistry, but it's only safe to call from closures
+    //made by pushClosure (or functions with no upvalues, then it's null)
+    static LuaConsoleModel * getFromUpvalue(lua_State * L);
+
+    //as above, but lua errors instead of returning null
+    static LuaConsoleModel * checkFromUpvalue(lua_State * L);
+
+    //push func as C closure with our pointer userdata as its' only upvalue onto
+    //the attached state, so func can get us with getFromUpvalue, returns false
+    //and pushes nothing if no state is attached
+    bool pushClosure(LuaCFunction func);
+
     //ctor, does NOT allocate lua state, takes a bitflag of ECONSOLE_OPTION values
     LuaConsoleModel(unsigned options = ECO_DEFAULT);
 
@@ -154,20 +338,173 @@ public:
 
     //sets the lua state and attaches console to it, unattaches from last state
     //if not called or called with null console will print errors on usage
+    //besides 'echo' and 'echochannel' globals this sets global 'console' table,
+    //the console library, all of its' functions get us with getFromUpvalue:
+    //echo(str), echocolored(str, color), echolines(lines [, color]),
+    //echospans(str, spans), echomarkup(str), echochannel(channel, severity, msg, ...),
+    //setcolor(name, color), getcolor(name), settitle(str), gettitle(),
+    //scroll(lines or 'top' or 'bottom'), clear(), setvisible(bool), isvisible(),
+    //addhistory(str), gethistory(index from 1, oldest first), historysize(),
+    //setredirect(bool), getredirect(), stats()
+    //and 'handle' is the userdata to pass to blua_echo from FFI, color names
+    //are lowercase names of ECONSOLE_COLOR values without ECC_ ('error', etc.)
     void setL(lua_State * L);
 
     //print line to console in the default echo color (see ECC_ECHO)
     //this is accessible from lua too, as 'echo' and takes single string there too
+    //(see echoLuaString)
     void echo(const std::string& str);
 
+    //as above, but straight from len chars at str (that can contain nulls),
+    //the only allocations are for the line kept in scrollback
+    void echo(const char * str, std::size_t len);
+
+    //as above, for null terminated str
+    void echo(const char * str);
+
+#ifdef BLA_HAS_RVALUE_REFERENCES
+    //as above, but str's buffer itself is kept in scrollback
+    void echo(std::string&& str);
+#endif
+
+#ifdef BLA_HAS_STRING_VIEW
+    //as above, for any string_view
+    void echo(std::string_view str);
+#endif
+
+    //print string at index of L to console in textcolor, L must be the attached
+    //state or one of its' threads, strings at least 4KB long aren't copied but
+    //pinned in the registry and drawn straight from lua's bytes until they are
+    //dropped from scrollback or console is detached (then they get copied)
+    //this is what the 'echo' accessible from lua uses
+    void echoLuaString(lua_State * L, int index, unsigned textcolor);
+
+    //print printf formatted line to console in the default echo color, it's
+    //formatted into a buffer that is kept and reused by all later calls
+    void echof(const char * fmt, ...);
+
     //print line to console with all characters in the specified color
     void echoColored(const std::string& str, unsigned textcolor);
 
+    //as above, with the same overloads as echo has
+    void echoColored(const char * str, std::size_t len, unsigned textcolor);
+    void echoColored(const char * str, unsigned textcolor);
+
+#ifdef BLA_HAS_RVALUE_REFERENCES
+    void echoColored(std::string&& str, unsigned textcolor);
+#endif
+
+#ifdef BLA_HAS_STRING_VIEW
+    void echoColored(std::string_view str, unsigned textcolor);
+#endif
+
     //print line to console, with each character having a color set individually
     //if there are more they are ignored, if there are less, the rest are printed
     //in default echo color (see ECC_ECHO)
     void echoLine(const std::string& str, const ColorString& colors);
 
+    //print line to console in default echo color, except for chars in spans
+    //which are in colors of their spans, later spans win where they overlap,
+    //spans past the end of line are cut, each span is one fill of its' chars
+    //this is accessible from lua too, as 'console.echospans(str, spans)' with
+    //spans being a flat array of 1 based start, length and color of each span
+    void echoSpans(const char * str, std::size_t len, const ColorSpan * spans, std::size_t count);
+
+    //print line with inline color markup to console, '{#rrggbb}' or
+    //'{#rrggbbaa}' (in hex) switches to that color, '{#}' back to default echo
+    //color and '{{' is a single '{', anything else is printed as it is
+    //this is accessible from lua too, as 'console.echomarkup(str)'
+    void echoMarkup(const char * str, std::size_t len);
+
+    //set lowest severity that channel shows, messages of lower severities
+    //are dropped before anything is done with them, ECS_OFF turns channel off
+    //and by default each channel shows ECS_INFO and higher
+    void setChannelSeverity(unsigned channel, ECONSOLE_SEVERITY severity);
+
+    //get lowest severity that channel shows, ECS_OFF for channels past kChannelCount
+    ECONSOLE_SEVERITY getChannelSeverity(unsigned channel) const;
+
+    //check whether or not message of severity on channel would be shown, use
+    //this to not build strings that would just be dropped
+    bool isChannelEnabled(unsigned channel, ECONSOLE_SEVERITY severity) const;
+
+    //print line to console in color of severity, if channel shows it
+    //this is accessible from lua too, as 'echochannel(channel, severity, msg, ...)',
+    //where severity is a number or 'trace', 'debug', 'info', 'warning' or
+    //'error', and if channel shows it then msg is echoed, or if there are more
+    //arguments it's string.format'ed with them, or if it's a function it gets
+    //called with them and what it returns is echoed, so nothing is built or
+    //called at all when channel doesn't show that severity
+    void echoChannel(unsigned channel, ECONSOLE_SEVERITY severity, const std::string& str);
+
+    //as above, but the line is printf formatted and only if channel shows it
+    void echoChannelFormat(unsigned channel, ECONSOLE_SEVERITY severity, const char * fmt, ...);
+
+    //start a batch of echoes, until the matching endBatch lines are only
+    //stored, they are wrapped to console width (and written to scrollback
+    //file) and console scrolls to the end just once in endBatch, lines that
+    //get dropped before then are never wrapped at all, unless cold scrollback
+    //or scrollback file want them, batches nest and parseLastLine runs each
+    //command in one, screen buffer isn't updated until the batch ends
+    void beginBatch();
+
+    //end a batch of echoes, see beginBatch
+    void endBatch();
+
+    //echo each string in [begin, end) like echo does, all in a single batch
+    //this is accessible from lua too, as 'console.echolines(lines [, color])'
+    //that echoes strings in array lines in color (or default echo color)
+    template <typename Iterator>
+    void echoLines(Iterator begin, Iterator end)
+    {
+        beginBatch();
+        for(; begin != end; ++begin)
+            echo(*begin);
+
+        endBatch();
+    }
+
+    //append len chars at str to the output buffer, the complete lines in it
+    //are echoed in default echo color when output is flushed, not on each
+    //write, this is what print, io.write and io.stdout:write use when output
+    //is redirected (see setRedirectOutput), if buffer grows past 64KB within
+    //one command it's flushed right away, even if it's one long partial line
+    void writeOutput(const char * str, std::size_t len);
+
+    //echo all complete lines in the output buffer in a single batch, a partial
+    //line stays in it until its' newline comes, call this once per frame to
+    //show output written outside of commands, parseLastLine flushes all at the
+    //end of each command and any echo flushes all first, so order is kept,
+    //lines captured from stdout and stderr (see openOutputCapture) are echoed
+    //here too, and before and after each command
+    void flushOutput();
+
+    //start capturing what the process writes to stdout and/or stderr, that's
+    //file descriptors 1 and 2, so printf, std::cout and fprintf(stderr) of
+    //any library or thread, a background thread drains them through pipes so
+    //writers never wait on the console, lines are echoed in batches when
+    //output is flushed, the ones from stderr in ECC_ERROR color, with tee they
+    //still go to the original streams as well, this is POSIX only and returns
+    //false if neither could be captured
+    bool openOutputCapture(bool capturestdout = true, bool capturestderr = true, bool tee = false);
+
+    //put original stdout and stderr back and echo what was captured till now
+    void closeOutputCapture();
+
+    //check whether or not stdout or stderr is being captured
+    bool isOutputCaptureOpen() const;
+
+    //set whether or not print, io.write and io.stdout:write of attached state
+    //(and of states attached later) are replaced by ones that write to the
+    //output buffer (see writeOutput) instead of process stdout, io.write only
+    //does so while default output file is io.stdout, turning it off restores
+    //the original functions, this is off unless ECO_REDIRECT_OUTPUT is passed
+    //this is accessible from lua too, as 'console.setredirect(bool)'
+    void setRedirectOutput(bool redirect);
+
+    //check whether or not output of attached state is redirected to console
+    bool getRedirectOutput() const;
+
     //get the title, by default console has empty ("") title
     const std::string& getTitle() const;
 
@@ -203,28 +540,79 @@ public:
     //check whether or not pressing enter with empty prompt repeats last history command
     bool getEnterRepeatLast() const;
 
-    //set new size of history buffer
+    //set how many items history can hold at most, if there are more items
+    //than that already then the oldest ones are dropped
+    void setHistoryCapacity(std::size_t newcapacity);
+
+    //get how many items history can hold at most
+    std::size_t getHistoryCapacity() const;
+
+    //kept for compatibility, same as setHistoryCapacity
     void setHistorySize(std::size_t newsize);
 
-    //set certain item of history buffer to a value
+    //add item as the newest one in history, dropping the oldest one if the
+    //history is at capacity, this is O(1) no matter how big the history is
+    void addHistoryItem(const std::string& item);
+
+    //set certain item of history buffer to a value, index 0 is the oldest item
+    //and getHistorySize() - 1 is the newest, indices past the size are ignored
     void setHistoryItem(std::size_t index, const std::string& item);
 
-    //get current size of history buffer
+    //get count of items actually in history, never more than capacity
     std::size_t getHistorySize() const;
 
-    //get content of certain item of history buffer
+    //get content of certain item of history buffer, index 0 is the oldest item
     const std::string& getHistoryItem(std::size_t index) const;
 
-    //load history from a file, this uses ifstream and loads last history size
-    //lines from the file if you want own fs handling, different behaviour, etc.
-    //then use get/set history item/size
-    bool loadHistoryFromFile(const std::string& filename);
+    //set whether or not a line equal to the newest history item is skipped
+    //instead of being added to history again, this is off by default
+    void setHistoryIgnoreDups(bool ignore);
+
+    //check whether or not lines equal to the newest history item are skipped
+    bool getHistoryIgnoreDups() const;
+
+    //set whether or not the newest history item that starts with the prompt
+    //line is shown after it in ECC_SUGGESTION color, like fish shell does,
+    //this is on by default, see acceptSuggestion
+    void setHistorySuggestions(bool suggest);
+
+    //check whether or not history suggestions are shown
+    bool getHistorySuggestions() const;
+
+    //load history from a file, this loads last history capacity lines from
+    //the file, on POSIX the file is memory mapped and scanned backwards from
+    //the end so only those last lines are ever touched, no matter how big the
+    //file is, elsewhere it uses ifstream and reads the whole file
+    //bool append controls whether loaded lines replace current history (the
+    //default) or get added after it, either way it's left as it was if the
+    //file can't be read or has no lines
+    //if you want own fs handling, different behaviour, etc.
+    //then use add/get/set history item/size
+    bool loadHistoryFromFile(const std::string& filename, bool append = false);
 
     //save history to file, this uses ofstream and either appends all lines to
     //specified file or overwrites the file and fills it with the history lines
     //bool append controls whether to append or overwrite
     void saveHistoryToFile(const std::string& filename, bool append = true);
 
+    //start appending each new history line to the file as it's entered, this
+    //is done by a background thread using O_APPEND and flock so any number of
+    //processes can share one file without overwriting each other or losing
+    //lines on a crash, lines other processes append get added to our history
+    //too and the file gets compacted to last history capacity lines now and
+    //then, this is POSIX only and returns false if it can't open the file
+    bool openHistoryJournal(const std::string& filename);
+
+    //write out all queued lines and stop journaling
+    void closeHistoryJournal();
+
+    //check whether or not the history journal is open
+    bool isHistoryJournalOpen() const;
+
+    //add lines other processes appended to the journal to history, this is
+    //done automatically on enter and when starting history browsing or search
+    void pollHistoryJournal();
+
     //set characters that jumping over words won't consider part of a word
     //see moveCursorOneWord for explanation about what exactly happens then
     //PS: this is set to a sane default for lua
@@ -245,6 +633,134 @@ public:
     //check whether or not evals print to console
     bool getPrintEval() const;
 
+    //set limits of printing returned tables: how many levels deep nested tables
+    //are printed, how many entries of each table are printed and how many
+    //bytes are printed in total, past them ... is printed, defaults are 4,
+    //100 and 64KB, returned strings themselves are always printed whole, like
+    //print would, each line is echoed as soon as it's done so even huge
+    //tables never get turned into one big string first
+    void setPrintEvalLimits(std::size_t depth, std::size_t items, std::size_t bytes);
+
+    //get how many levels deep nested returned tables are printed
+    std::size_t getPrintEvalDepth() const;
+
+    //get how many entries of each returned table are printed
+    std::size_t getPrintEvalItems() const;
+
+    //get how many bytes of returned values are printed
+    std::size_t getPrintEvalBytes() const;
+
+    //set whether or not returned tables are inspected instead of printed,
+    //an inspected table is kept alive by a registry reference and gets an id,
+    //only first page of its' entries is printed, one per line, and entries
+    //that are tables get ids too, so they can be opened later, this way only
+    //tables that are opened are ever looked at, this is off by default
+    //also available as comment commands: --open N, --more N and --close N
+    void setInspectResults(bool inspect);
+
+    //check whether or not returned tables are inspected
+    bool getInspectResults() const;
+
+    //print first page of entries of inspected table with given id
+    void openInspectedTable(unsigned id);
+
+    //print next page of entries of inspected table with given id
+    void moreInspectedTable(unsigned id);
+
+    //stop inspecting table with given id and tables found in it, releasing
+    //their' references
+    void closeInspectedTable(unsigned id);
+
+    //set how many bytes each command can take on top of what the state held
+    //when it started, while it compiles and runs, so a runaway one fails
+    //with a lua memory error instead of eating all memory of the process,
+    //this only works if attached state was made with LuaConsoleAllocator
+    //(it's found with lua_getallocf) and 0 turns it off, which is the default
+    void setCommandMemoryLimit(std::size_t bytes);
+
+    //get how many bytes each command can take, 0 if there's no limit
+    std::size_t getCommandMemoryLimit() const;
+
+    //set whether or not each command is followed by a line in ECC_STATS color
+    //with how long it took to compile and to run, cpu time it used, how much
+    //lua memory changed and how many gc cycles finished, off by default, the
+    //metrics are recorded either way (see getCommandHistogram)
+    void setShowCommandStats(bool show);
+
+    //check whether or not stats are shown after each command
+    bool getShowCommandStats() const;
+
+    //get metrics of the last complete command, zeros before the first one
+    const CommandStats& getLastCommandStats() const;
+
+    //get aggregate of metric over all commands since start or reset
+    //this is accessible from lua too, as 'console.stats()' that returns a
+    //table with 'last' table of metrics of the last command and histograms
+    //of each metric: 'compile', 'wall', 'cpu', 'memory' and 'gc', each a
+    //table with count, sum, min, max and buckets (array, bucket 0 at 1)
+    const StatsHistogram& getCommandHistogram(ECOMMAND_METRIC metric) const;
+
+    //clear last command metrics and all histograms
+    void resetCommandStats();
+
+    //start sampling profiler on attached state, once per interval seconds a
+    //timer thread sends SIGPROF to the calling thread (which must be the one
+    //that runs the state) and its' handler arms a one shot hook that walks the
+    //stack into a call tree, there's no hook between samples so it's cheap
+    //enough to leave running on a live program, returns false if there's no
+    //state, it has another hook or SIGPROF is taken, a hook set later by lua
+    //code is left alone and ends profiling, starting again clears the
+    //samples, only lua code runs hooks so time in a long C call or coroutine
+    //is sampled at the line that called it
+    //this is accessible as comments too: '--profile start [ms]', '--profile
+    //stop' and '--profile report [count]'
+    bool startProfiler(double interval = 0.01);
+
+    //stop sampling, samples are kept until next start
+    void stopProfiler();
+
+    //check whether or not profiler is sampling
+    bool isProfilerRunning() const;
+
+    //echo top count functions by self and by total samples, top count lines
+    //by self samples and the call tree (nodes with at least 1% of samples)
+    void reportProfile(std::size_t count = 10u);
+
+    //compile code once (with return added first, like commands) and time it
+    //like IPython's timeit, calls is how many times to call it in all, warm
+    //up included, 0 means until budget seconds pass, and echo one line with
+    //min, median and p99 time per call and bytes allocated per call, batch
+    //size is picked so clock reads don't matter, also accessible as comment
+    //'--time [calls] code'
+    void timeCode(const std::string& code, std::size_t calls = 0u, double budget = 1.0);
+
+    //collect garbage of attached state in small steps until budget seconds
+    //pass or the cycle finishes, call it each frame after drawing so that
+    //collection happens there and not in the middle of the next frame, a new
+    //cycle is only started once lua memory grew by half over what was in use
+    //after the last one so it costs next to nothing when there's no garbage,
+    //a step can't be cut short so a call can go over budget by one step, it
+    //also writes out lines queued for the scrollback file outside of batches
+    //this is accessible from lua too, as 'console.idle(budget)'
+    void idle(double budget);
+
+    //set whether or not automatic collection of attached state is stopped,
+    //so only idle collects, then idle must be called often and with enough
+    //budget or memory grows without limit, off by default, this is accessible
+    //from lua too, as 'console.setsuppressgc(bool)'
+    void setSuppressAutoGc(bool suppress);
+
+    //check whether or not automatic collection is stopped
+    //this is accessible from lua too, as 'console.getsuppressgc()'
+    bool getSuppressAutoGc() const;
+
+    //get stats of idle collection, comment '--gc' echoes them together with
+    //memory in use and how much it grew since the last finished cycle
+    const IdleGcStats& getIdleGcStats() const;
+
+    //clear idle collection stats
+    void resetIdleGcStats();
+
     //this will always try evalute with "return " added to the string first
     //to allow returning values easily without typing return in user code
     void setAddReturn(bool add);
@@ -263,6 +779,66 @@ public:
     //clear the console screen space messages (but not the history)
     void clearScreen();
 
+    //set whether or not echoing same line (and colors) as the last one just
+    //counts it on the last line, which is then drawn with ' (xN)' at its' end,
+    //instead of adding it again, this is off by default
+    void setCollapseRepeats(bool collapse);
+
+    //check whether or not repeated lines are collapsed
+    bool getCollapseRepeats() const;
+
+    //set how many wide lines that fell out of the 3000 messages kept as they
+    //are are still kept compressed in blocks of about 32KB, user can scroll
+    //back to them and a block is only decompressed when it's on screen, 0
+    //turns it off and is the default
+    void setColdScrollbackLines(std::size_t lines);
+
+    //get how many wide lines are kept compressed at most
+    std::size_t getColdScrollbackLines() const;
+
+    //set how many compressed blocks stay in memory, older ones are written to
+    //a temp file (if one can be made), 0 keeps all of them in memory and is
+    //the default
+    void setColdScrollbackMemoryBlocks(std::size_t blocks);
+
+    //get how many compressed blocks stay in memory
+    std::size_t getColdScrollbackMemoryBlocks() const;
+
+    //start writing each wide line to the file as it's echoed, lines that were
+    //already in the file (from previous runs) are memory mapped and shown
+    //above all others right away, since the file has an index of where each
+    //line starts, lines are only read when scrolled to and opening costs the
+    //same no matter how big the file is, if the file has more lines than
+    //set with setScrollbackFileLines then older ones are cut off on open,
+    //lines are written at the end of each batch, in idle, on close and
+    //whenever 64 KB of them piled up, this is POSIX only and returns false if it can't open the file
+    bool openScrollbackFile(const std::string& filename);
+
+    //stop writing lines to the scrollback file and stop showing its' old lines
+    void closeScrollbackFile();
+
+    //check whether or not the scrollback file is open
+    bool isScrollbackFileOpen() const;
+
+    //set how many last lines are kept in the scrollback file when it's opened,
+    //0 means all of them, default is 100000
+    void setScrollbackFileLines(std::size_t lines);
+
+    //get how many last lines are kept in the scrollback file when it's opened
+    std::size_t getScrollbackFileLines() const;
+
+    //search all of scrollback for text, show all matches in ECC_MATCH color
+    //and scroll to the newest one, returns count of matches, empty text
+    //removes the highlighting, lines echoed later are not searched, this
+    //includes cold scrollback (decompressing its' blocks one at a time) and
+    //the archive of the scrollback file (parsing its' lines one at a time)
+    //this is also available as '--grep text' comment command
+    std::size_t grepScrollback(const std::string& text);
+
+    //scroll to the next newer (change > 0) or older (change < 0) match of last
+    //grepScrollback, wrapping around, use this for F3 and Shift + F3
+    void jumpToMatch(int change);
+
     //API FOR CONTROLLER:///////////////////////////////////////////////////////
 
     //move cursor by given amount of characters, itll be clipped to [0,lastlinesize]
@@ -275,6 +851,11 @@ public:
     //pass kScrollLinesEnd or kScrollLinesBegin to go as much back/forth as possible
     void scrollLines(int amount);
 
+    //if cursor is at end of prompt line and a history suggestion is shown then
+    //put it into the prompt line and return true, otherwise return false
+    //use this for Right/End keys and move the cursor only if it returns false
+    bool acceptSuggestion();
+
     //move cursor by one word left or right (see EMOVE_DIRECTION) like
     //bash (at least KDE and xfce terminals) does, that is:
     //when moving left, skip a word and land on its' first char
@@ -287,6 +868,20 @@ public:
     //use this (pass -1 and 1) for Up/Down arrows to get bash-like history behavior
     void readHistory(int change);
 
+    //start bash-like reverse incremental search in history, or if already
+    //searching then jump to the next older match, use this for Ctrl + R
+    //while searching addChar and backspace edit the searched text and anything
+    //else that moves the cursor or sends the line first accepts the match
+    void searchHistory();
+
+    //stop searching history, if accept is true the match is put into the
+    //prompt line, if not then the line from before search is brought back
+    //use this (pass false) for Escape
+    void stopHistorySearch(bool accept);
+
+    //check whether or not we are in the middle of a history search
+    bool isSearchingHistory() const;
+
     //send last line to lua state (or print error), incomplete chunks are handled OK too
     //it returns whether code chunk ran, had errors in parse/run or is not yet completed
     //use this for Enter/Return key press
@@ -322,13 +917,42 @@ public:
 
 private:
     ScreenCell * getCells(int x, int y) const;
-    const std::string& getWideMsg(int index) const;
-    const ColorString& getWideColor(int index) const;
+    const priv::ColoredLine& getWideLine(int index) const;
+    std::size_t getWideLineCount() const;
+    std::size_t getColdLineCount() const;
+    std::size_t getArchivedLineCount() const;
+    void echoMessage(const char * str, std::size_t len, const ColorString * colors, unsigned fill, std::string * take);
+    bool repeatLastMessage(const char * str, std::size_t len, const ColorString * colors, unsigned fill);
+    void addMessage();
+    void endEcho();
+    void unpinMessages(bool copy);
+    void releaseDroppedPins(lua_State * L);
+    int formatToBuffer(const char * fmt, va_list args);
+    void flushOutputLines(bool all);
+    void redirectOutput(bool redirect);
+    void pollOutputCapture();
+    void recordCommandStats(const CommandStats& stats);
+    void echoGcStats();
+    void wrapMessages();
+    void dropOldestMessage();
     void updateBuffer() const;
     void printLuaStackInColor(int first, int last, unsigned color);
-    bool tryEval(bool addreturn);
+    void inspectLuaStack(int first, int last, unsigned color);
+    void echoInspectedPage(unsigned id, bool restart);
+    int tryEval(bool addreturn);
     void checkSpecialComments();
     void ensureCurInView();
+    const std::string& getHistoryItemBySeq(std::size_t seq) const;
+    static const std::string& historyItemBySeq(std::size_t seq, void * data);
+    void runHistorySearch(std::size_t before, bool skipmatch);
+    std::string getSearchPrompt() const;
+    void reindexHistory();
+    void clearHistoryItems();
+    void showCurrentMatch();
+    std::size_t grepWideLines(const std::string& text, std::size_t count);
+    bool isMatchGone(const priv::ScrollbackMatch& match) const;
+    void dropArchivedMatches();
+    const std::string * findSuggestion() const;
 
     CallbackFunc m_callbackfuncs[ECALLBACK_TYPE_COUNT]; //callbakcs called on certain events
     void * m_callbackdata[ECALLBACK_TYPE_COUNT]; //data for callbacks
@@ -338,11 +962,26 @@ private:
     int m_cur; //position of cursor in last line
     std::string m_buffcmd; //command buffer for uncompleted chunks
     lua_State * L; //lua state we are talking with
-    std::vector<std::string> m_history; //the history buffer
+    std::vector<std::string> m_history; //the history ring buffer, its' size is the capacity
+    std::size_t m_hstart; //index in m_history of the oldest history item
+    std::size_t m_hsize; //count of items actually in history
+    std::size_t m_hnext; //sequence number the next added history item will get
+    priv::HistoryIndex * m_hsearchindex; //trigram index of history for searching
+    priv::HistoryTrie * m_hprefixtrie; //prefix trie of history for suggestions
+    bool m_hsuggest; //do we show history suggestions after the prompt line
+    priv::HistoryJournal * m_hjournal; //appends history to file as it's entered
+    bool m_hindexdirty; //was history edited in place so index needs a rebuild
+    std::size_t m_hlastprune; //sequence number at last pruning of the index
+    bool m_hignoredups; //skip adding lines equal to the newest history item
+    bool m_searching; //are we in reverse history search mode
+    bool m_searchfailed; //did last search attempt find nothing
+    std::string m_searchquery; //what we are searching history for
+    std::size_t m_searchmatch; //sequence number of current match, m_hnext if none
+    std::string m_presearchline; //last line saved when search started
     int m_hindex; //index in history
-    std::vector<priv::ColoredLine> m_msg; //actual messages that got echoed
+    std::deque<priv::ColoredLine> m_msg; //actual messages that got echoed
     int m_w; //width of console, not counting the borders
-    std::vector<priv::ColoredLine> m_widemsg; //messages adjusted/split to fit width of console
+    std::deque<priv::ColoredLine> m_widemsg; //messages adjusted/split to fit width of console
     const priv::ColoredLine m_empty; //empty line constant
     const unsigned m_options; //options passed at construction
     bool m_visible; //are we visible?
@@ -354,14 +993,67 @@ private:
     std::string m_skipchars; //characters we don't consider part of a word when jumping over words
     int m_firstmsg; //offset of first message - for scrolling
     bool m_printeval; //do we print returned values of handtyped scripts?
+    std::size_t m_printdepth; //how deep into returned tables we print
+    std::size_t m_printitems; //how many entries of each returned table we print
+    std::size_t m_printbytes; //how many bytes of returned values we print
+    bool m_inspect; //do we inspect returned tables instead of printing them
+    priv::Inspector * m_inspector; //tables being inspected
     bool m_addreturn; //do we try to add 'return ' to code to try return evaluated expressions
     std::string m_savedlastline; //last line saved when scrolling history
     bool m_commentcommands; //do we use special comments in prompt to trigger console commands
     unsigned m_lastlineoffset; //offset of last line when it's longer than term width
+    std::size_t m_widedropped; //how many wide messages were dropped from the front ever
+    std::string m_grep; //text last searched for in scrollback
+    std::vector<priv::ScrollbackMatch> m_matches; //matches of m_grep, oldest first
+    std::size_t m_curmatch; //index of match we last jumped to
+    priv::ColdScrollback * m_cold; //compressed wide lines older than m_widemsg
+    priv::ScrollbackFile * m_sbfile; //file wide lines are persisted to, with lines of past runs
+    std::size_t m_sbfilelines; //how many lines scrollback file is cut to on open
+    bool m_collapserepeats; //do we count repeats of last line instead of adding them
+    unsigned char m_channelseverity[kChannelCount]; //lowest shown severity of each channel
+    unsigned m_batchdepth; //how many batches of echoes we are in
+    bool m_batchechoed; //was anything echoed in current batch
+    std::size_t m_unwrapped; //how many last messages aren't in m_widemsg yet
+    std::vector<char> m_formatbuff; //reused buffer echof and echoChannelFormat format into
+    std::deque<int> m_pinnedrefs; //registry refs of lua strings pinned by m_msg, oldest first
+    std::vector<int> m_droppedpins; //refs of pinned strings of dropped messages, not released yet
+    std::string m_markuptext; //reused buffer for text of echoMarkup
+    ColorString m_spancolors; //reused buffer for colors of echoSpans and echoMarkup
+    bool m_redirectoutput; //do we replace print and io.write of attached state
+    std::string m_outbuff; //output written to us but not echoed yet
+    std::string m_outflush; //reused buffer output is moved to while it's being echoed
+    priv::OutputCapture * m_capture; //captures stdout and stderr of the process
+    std::size_t m_cmdmemlimit; //how many bytes a command can take, 0 if no limit
+    bool m_showstats; //do we echo stats after each command
+    CommandStats m_laststats; //metrics of the last command
+    StatsHistogram m_stathists[ECOMMAND_METRIC_COUNT]; //aggregates of all commands
+    priv::Profiler * m_profiler; //samples attached state when started
+    bool m_suppressgc; //do we keep automatic collection of attached state stopped
+    IdleGcStats m_idlestats; //stats of idle collection
+    double m_gcbase; //lua memory in use after last finished cycle
+    bool m_gcincycle; //did idle start a cycle that didn't finish yet
+    std::size_t m_gccycles; //gc counter when idle last looked at it
 
 };
 
 } //blua
 
+//plain C functions for LuaJIT's FFI (see luaconsoleffi.lua), so loops that
+//echo from lua stay compiled, console is the 'console.handle' userdata that
+//LuaConsoleModel puts into the state it's attached to and they do nothing if
+//that console is gone or was attached to another state since, the program has
+//to export them for ffi.C to find them (e.g. link with -rdynamic on Linux)
+extern "C" {
+
+//echo len chars at str in color, like echoColored does, it never touches the
+//lua state, not even to release long strings echo pinned that scroll out now,
+//that's left to the next echo, parseLastLine or setL
+BLA_EXPORT void blua_echo(void * console, const char * str, std::size_t len, unsigned color);
+
+//get color which (an ECONSOLE_COLOR), like getColor does, 0 if there's no console
+BLA_EXPORT unsigned blua_getcolor(void * console, int which);
+
+}
+
 #endif	/* LUACONSOLEMODEL_HPP */
 
@@ -0,0 +1,22 @@
+--binds echo straight to blua_echo exported by the program through LuaJIT's FFI,
+--so loops that echo stay compiled instead of aborting traces on the C API call
+--returns that echo (taking one string, or anything tostring takes) or nil if
+--this is not LuaJIT, there is no console or the program doesn't export blua_echo
+local ok, ffi = pcall(require, 'ffi')
+if not ok or type(console) ~= 'table' or not console.handle then return nil end
+
+pcall(ffi.cdef, [[
+void blua_echo(void * console, const char * str, size_t len, unsigned color);
+unsigned blua_getcolor(void * console, int which);
+]]) --fails if already declared by an earlier run, that's fine
+
+local C = ffi.C
+if not pcall(function() return C.blua_echo, C.blua_getcolor end) then return nil end
+
+local handle = console.handle --userdata is passed as pointer to its' payload
+local ECC_ECHO = 3
+
+return function(str)
+    if type(str) ~= 'string' then str = tostring(str) end
+    C.blua_echo(handle, str, #str, C.blua_getcolor(handle, ECC_ECHO))
+end
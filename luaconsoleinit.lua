@@ -1,11 +1,18 @@
+--under LuaJIT echo through the FFI, that keeps loops that echo compiled
+local ok, ffiecho = pcall(dofile, 'luaconsoleffi.lua')
+if ok and ffiecho then echo = ffiecho end
+
 local oldecho = echo --we need old echo to send string we format in echo
 function echo(...) --echo takes one str arg, we define better one here
+    if select('#', ...) == 1 and type(...) == 'string' then return oldecho(...) end
     local arg = {...}
     local count = select('#', ...)
     for i=1, count do arg[i] = tostring(arg[i]) end --we need strs for concat
     oldecho(table.concat(arg, ' '))
 end
 
+--console.setredirect(true) --uncomment to have print and io.write go to console too
+
 function printf(format, ...) --just for convinence
     oldecho(format:format(...))
 end
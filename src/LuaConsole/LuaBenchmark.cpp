@@ -0,0 +1,121 @@
+#include <LuaConsole/LuaBenchmark.hpp>
+#include <LuaConsole/LuaCommandStats.hpp>
+#include <LuaConsole/LuaHeader.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace blua {
+namespace priv {
+
+//how long a batch should take, so clock reads are a tiny part of it
+const double kBatchSeconds = 1e-4;
+
+//most samples kept when running until budget, in case calls are very fast
+const std::size_t kMaxBenchmarkSamples = 100000u;
+
+//call function on top of L count times, on error leave message on top
+static bool callBatch(lua_State * L, std::size_t count)
+{
+    for(std::size_t i = 0u; i < count; ++i)
+    {
+        lua_pushvalue(L, -1);
+        if(lua_pcall(L, 0, 0, 0) != BLA_LUA_OK)
+            return false;
+    }
+    return true;
+}
+
+bool runBenchmark(lua_State * L, std::size_t calls, double budget, BenchmarkResult& result)
+{
+    //warm up while finding a batch size that takes long enough, with the
+    //collector stopped so memory only grows, by what calls allocated, and the
+    //last warm up batch tells bytes per call, these calls count too, so when
+    //calls are given the function is called exactly that many times in all
+    std::vector<double> warmup;
+    const bool gcrunning = bla_lua_gcisrunning(L);
+    lua_gc(L, LUA_GCSTOP, 0);
+    std::size_t batch = 1u;
+    bool ok = true;
+    result.Calls = 0u;
+    while(true)
+    {
+        const double memstart = getLuaMemory(L);
+        const double start = getWallSeconds();
+        ok = callBatch(L, batch);
+        const double took = getWallSeconds() - start;
+        if(!ok)
+            break;
+
+        result.Bytes = std::max(getLuaMemory(L) - memstart, 0.0) / batch;
+        warmup.push_back(took / batch);
+        result.Calls += batch;
+        if(took >= kBatchSeconds || (calls != 0u && result.Calls + 2u * batch > calls))
+            break;
+
+        batch *= 2u;
+    }
+
+    if(gcrunning)
+        lua_gc(L, LUA_GCRESTART, 0);
+
+    if(!ok)
+        return false;
+
+    std::vector<double> samples;
+    const double end = getWallSeconds() + budget;
+    while(calls?(result.Calls < calls):(samples.empty() || (getWallSeconds() < end && samples.size() < kMaxBenchmarkSamples)))
+    {
+        const std::size_t count = calls?std::min(batch, calls - result.Calls):batch;
+        const double start = getWallSeconds();
+        if(!callBatch(L, count))
+            return false;
+
+        samples.push_back((getWallSeconds() - start) / count);
+        result.Calls += count;
+    }
+
+    //so few calls were asked for that warm up made all of them
+    if(samples.empty())
+        samples.swap(warmup);
+
+    std::sort(samples.begin(), samples.end());
+    const std::size_t n = samples.size();
+    result.Batch = batch;
+    result.Min = samples[0];
+    result.Median = (n % 2u)?samples[n / 2u]:(samples[n / 2u - 1u] + samples[n / 2u]) * 0.5;
+    result.P99 = samples[std::min(n - 1u, (n * 99u + 99u) / 100u - 1u)];
+    return true;
+}
+
+//print seconds with unit that keeps them short, calls can be very fast
+static int formatTime(char * buff, double seconds)
+{
+    if(seconds < 1e-6)
+        return std::sprintf(buff, "%.1f ns", seconds * 1e9);
+
+    if(seconds < 1e-3)
+        return std::sprintf(buff, "%.2f us", seconds * 1e6);
+
+    if(seconds < 1.0)
+        return std::sprintf(buff, "%.2f ms", seconds * 1e3);
+
+    return std::sprintf(buff, "%.2f s", seconds);
+}
+
+std::string formatBenchmark(const BenchmarkResult& result)
+{
+    char buff[200];
+    char * at = buff;
+    at += std::sprintf(at, "min ");
+    at += formatTime(at, result.Min);
+    at += std::sprintf(at, ", median ");
+    at += formatTime(at, result.Median);
+    at += std::sprintf(at, ", p99 ");
+    at += formatTime(at, result.P99);
+    std::sprintf(at, ", %.0f B per call, %lu calls", result.Bytes, static_cast<unsigned long>(result.Calls));
+    return buff;
+}
+
+} //priv
+} //blua
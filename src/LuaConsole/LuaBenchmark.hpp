@@ -0,0 +1,43 @@
+#ifndef LUABENCHMARK_HPP
+#define	LUABENCHMARK_HPP
+
+#include <string>
+
+struct lua_State;
+
+namespace blua {
+namespace priv {
+
+//results of runBenchmark, times are seconds per call
+
+class BenchmarkResult
+{
+public:
+    std::size_t Calls; //how many calls were made, warm up included
+    std::size_t Batch; //how many calls each timed batch made
+    double Min;
+    double Median;
+    double P99;
+    double Bytes; //bytes allocated per call
+
+};
+
+//call function on top of L many times and time it, calls are made in batches
+//that take about 100 us each (doubling batch from 1 until one does, that's
+//the warm up, it runs with collector stopped and its' last batch tells how
+//much memory a call allocates), each batch time divided by its' size is one
+//sample, if calls is 0 it runs batches until budget seconds pass, else the
+//function is called exactly calls times, warm up included (if warm up made
+//all of them then its' batches are the samples), function stays on the
+//stack, if a call raises an error it returns false with the error message
+//pushed on top of it
+bool runBenchmark(lua_State * L, std::size_t calls, double budget, BenchmarkResult& result);
+
+//make one short line with all results but batch size
+std::string formatBenchmark(const BenchmarkResult& result);
+
+} //priv
+} //blua
+
+#endif	/* LUABENCHMARK_HPP */
+
@@ -0,0 +1,348 @@
+#include <LuaConsole/LuaColdScrollback.hpp>
+#include <LuaConsole/LuaCompress.hpp>
+#include <algorithm>
+
+namespace blua {
+namespace priv {
+
+//seal open block once its' lines serialize to this many bytes, it goes over
+//by at most one wide line (screen width chars), so it stays well under
+//kMaxCompressInput
+const std::size_t kColdBlockBytes = 32u * 1024u;
+
+//don't bother compacting spill file until this much of it is dead
+const long kSpillCompactBytes = 1024 * 1024;
+
+//no sane color run is longer than this, so broken data can't make us allocate a lot
+const std::size_t kMaxColorRun = 1024u * 1024u;
+
+static void putVarint(std::string& out, std::size_t v)
+{
+    while(v >= 0x80u)
+    {
+        out += static_cast<char>((v & 0x7fu) | 0x80u);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+static bool getVarint(const char * in, std::size_t size, std::size_t& pos, std::size_t& v)
+{
+    v = 0u;
+    for(unsigned shift = 0u; pos < size && shift < 64u; shift += 7u)
+    {
+        const unsigned char c = static_cast<unsigned char>(in[pos++]);
+        v |= static_cast<std::size_t>(c & 0x7fu) << shift;
+        if(!(c & 0x80u))
+            return true;
+    }
+    return false;
+}
+
+void serializeColoredLine(std::string& out, const ColoredLine& line)
+{
+    //pinned lines have as many colors as chars, they just store one
+    const std::size_t size = line.getSize();
+    const std::size_t colors = line.Pinned?size:line.Color.size();
+    putVarint(out, size);
+    out.append(line.getText(), size);
+
+    std::size_t runs = 0u;
+    for(std::size_t i = 0u; i < colors; ++i)
+        if(i == 0u || line.getColor(i) != line.getColor(i - 1u))
+            ++runs;
+
+    putVarint(out, runs);
+    std::size_t start = 0u;
+    for(std::size_t i = 1u; i <= colors; ++i)
+    {
+        if(i < colors && line.getColor(i) == line.getColor(start))
+            continue;
+
+        const unsigned color = line.getColor(start);
+        putVarint(out, i - start);
+        for(unsigned b = 0u; b < 4u; ++b)
+            out += static_cast<char>((color >> (8u * b)) & 0xffu);
+
+        start = i;
+    }
+}
+
+bool parseColoredLine(const char * in, std::size_t size, std::size_t& pos, ColoredLine& line)
+{
+    std::size_t len, runs;
+    if(!getVarint(in, size, pos, len) || size - pos < len)
+        return false;
+
+    line.Text.assign(in + pos, len);
+    pos += len;
+
+    if(!getVarint(in, size, pos, runs))
+        return false;
+
+    line.Color.clear();
+    for(std::size_t r = 0u; r < runs; ++r)
+    {
+        std::size_t runlen;
+        if(!getVarint(in, size, pos, runlen) || size - pos < 4u || runlen > kMaxColorRun)
+            return false;
+
+        unsigned color = 0u;
+        for(unsigned b = 0u; b < 4u; ++b)
+            color |= static_cast<unsigned>(static_cast<unsigned char>(in[pos + b])) << (8u * b);
+
+        pos += 4u;
+        line.Color.append(runlen, color);
+    }
+    return true;
+}
+
+ColdScrollback::ColdScrollback() :
+m_maxlines(0u),
+m_memblocks(0u),
+m_begin(0u),
+m_end(0u),
+m_spilled(0u),
+m_spillfile(0x0),
+m_spillend(0),
+m_spilldead(0),
+m_cachenext(0u) { }
+
+ColdScrollback::~ColdScrollback()
+{
+    if(m_spillfile)
+        std::fclose(m_spillfile);
+}
+
+void ColdScrollback::setMaxLines(std::size_t lines)
+{
+    m_maxlines = lines;
+    if(m_maxlines == 0u)
+        clear(m_end);
+
+    while(m_end - m_begin > m_maxlines && !m_blocks.empty())
+        dropOldest();
+}
+
+std::size_t ColdScrollback::getMaxLines() const
+{
+    return m_maxlines;
+}
+
+void ColdScrollback::setMemoryBlocks(std::size_t blocks)
+{
+    m_memblocks = blocks;
+    while(m_memblocks != 0u && m_blocks.size() - m_spilled > m_memblocks)
+        spill();
+}
+
+std::size_t ColdScrollback::getMemoryBlocks() const
+{
+    return m_memblocks;
+}
+
+void ColdScrollback::push(const ColoredLine& line)
+{
+    ++m_end;
+    if(m_maxlines == 0u)
+    {
+        m_begin = m_end;
+        return;
+    }
+
+    m_open.push_back(line);
+    m_open.back().unpin(); //lua string it's in could be unpinned any time
+    serializeColoredLine(m_openraw, m_open.back());
+    if(m_openraw.size() >= kColdBlockBytes)
+        seal();
+
+    while(m_end - m_begin > m_maxlines && !m_blocks.empty())
+        dropOldest();
+}
+
+std::size_t ColdScrollback::getBegin() const
+{
+    return m_begin;
+}
+
+std::size_t ColdScrollback::getEnd() const
+{
+    return m_end;
+}
+
+const ColoredLine& ColdScrollback::getLine(std::size_t line) const
+{
+    const std::size_t openfirst = m_end - m_open.size();
+    if(line >= openfirst)
+        return m_open[line - openfirst];
+
+    //binary search for the last block that starts at or before line
+    std::size_t lo = 0u, hi = m_blocks.size();
+    while(hi - lo > 1u)
+    {
+        const std::size_t mid = (lo + hi) / 2u;
+        if(line < m_blocks[mid].First)
+            hi = mid;
+        else
+            lo = mid;
+    }
+
+    const Block& block = m_blocks[lo];
+    for(unsigned i = 0u; i < 2u; ++i)
+        if(!m_cache[i].Lines.empty() && m_cache[i].First == block.First)
+            return m_cache[i].Lines[line - block.First];
+
+    CacheEntry& entry = m_cache[m_cachenext];
+    m_cachenext = (m_cachenext + 1u) % 2u;
+    entry.First = block.First;
+
+    //if it's broken somehow then still give right count of (empty) lines
+    if(!loadBlock(block, entry.Lines) || entry.Lines.size() != block.Count)
+        entry.Lines.assign(block.Count, ColoredLine());
+
+    return entry.Lines[line - block.First];
+}
+
+void ColdScrollback::clear(std::size_t end)
+{
+    m_blocks.clear();
+    m_spilled = 0u;
+    m_open.clear();
+    m_openraw.clear();
+    m_spillend = 0;
+    m_spilldead = 0;
+    m_cache[0].Lines.clear();
+    m_cache[1].Lines.clear();
+    m_begin = m_end = end;
+}
+
+void ColdScrollback::seal()
+{
+    Block block;
+    block.First = m_end - m_open.size();
+    block.Count = m_open.size();
+    block.SpillOffset = -1;
+    block.SpillSize = 0u;
+    compressBlock(m_openraw, block.Data);
+    m_blocks.push_back(block);
+
+    m_open.clear();
+    m_openraw.clear();
+
+    while(m_memblocks != 0u && m_blocks.size() - m_spilled > m_memblocks)
+        spill();
+}
+
+void ColdScrollback::spill()
+{
+    if(!m_spillfile)
+        m_spillfile = std::tmpfile();
+
+    //no temp file to be had, just keep everything in memory then
+    Block& block = m_blocks[m_spilled];
+    if(!m_spillfile || std::fseek(m_spillfile, m_spillend, SEEK_SET) != 0 ||
+       std::fwrite(block.Data.data(), 1u, block.Data.size(), m_spillfile) != block.Data.size())
+    {
+        m_memblocks = 0u;
+        return;
+    }
+
+    block.SpillOffset = m_spillend;
+    block.SpillSize = block.Data.size();
+    std::string().swap(block.Data);
+    m_spillend += block.SpillSize;
+    ++m_spilled;
+}
+
+void ColdScrollback::dropOldest()
+{
+    const Block& block = m_blocks.front();
+    for(unsigned i = 0u; i < 2u; ++i)
+        if(m_cache[i].First == block.First)
+            m_cache[i].Lines.clear();
+
+    m_begin = block.First + block.Count;
+    if(block.SpillOffset >= 0)
+    {
+        m_spilldead += block.SpillSize;
+        --m_spilled;
+    }
+    m_blocks.pop_front();
+
+    //blocks spill and drop oldest first, so once all are dead file starts over
+    if(m_spilled == 0u)
+    {
+        m_spillend = 0;
+        m_spilldead = 0;
+    }
+    else if(m_spilldead > kSpillCompactBytes && m_spilldead > m_spillend - m_spilldead)
+    {
+        compactSpillFile();
+    }
+}
+
+void ColdScrollback::compactSpillFile()
+{
+    std::FILE * file = std::tmpfile();
+    if(!file)
+        return;
+
+    //copy the live blocks to the new file, they are all at its' start
+    long end = 0;
+    std::string data;
+    for(std::size_t i = 0u; i < m_spilled; ++i)
+    {
+        Block& block = m_blocks[i];
+        data.resize(block.SpillSize);
+        if(std::fseek(m_spillfile, block.SpillOffset, SEEK_SET) != 0 ||
+           std::fread(&data[0], 1u, data.size(), m_spillfile) != data.size() ||
+           std::fwrite(data.data(), 1u, data.size(), file) != data.size())
+        {
+            std::fclose(file);
+            return;
+        }
+    }
+
+    for(std::size_t i = 0u; i < m_spilled; ++i)
+    {
+        m_blocks[i].SpillOffset = end;
+        end += m_blocks[i].SpillSize;
+    }
+
+    std::fclose(m_spillfile);
+    m_spillfile = file;
+    m_spillend = end;
+    m_spilldead = 0;
+}
+
+bool ColdScrollback::loadBlock(const Block& block, std::vector<ColoredLine>& lines) const
+{
+    std::string compressed;
+    const std::string * data = &block.Data;
+    if(block.SpillOffset >= 0)
+    {
+        compressed.resize(block.SpillSize);
+        if(std::fseek(m_spillfile, block.SpillOffset, SEEK_SET) != 0 ||
+           std::fread(&compressed[0], 1u, compressed.size(), m_spillfile) != compressed.size())
+            return false;
+
+        data = &compressed;
+    }
+
+    std::string raw;
+    if(!decompressBlock(*data, raw))
+        return false;
+
+    lines.clear();
+    std::size_t pos = 0u;
+    while(pos < raw.size())
+    {
+        lines.push_back(ColoredLine());
+        if(!parseColoredLine(raw.data(), raw.size(), pos, lines.back()))
+            return false;
+    }
+    return true;
+}
+
+} //priv
+} //blua
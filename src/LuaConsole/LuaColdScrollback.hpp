@@ -0,0 +1,110 @@
+#ifndef LUACOLDSCROLLBACK_HPP
+#define	LUACOLDSCROLLBACK_HPP
+
+#include <LuaConsole/LuaConsoleModel.hpp>
+#include <deque>
+#include <cstdio>
+
+namespace blua {
+namespace priv {
+
+//append line to out as varint text length, text, varint count of color runs
+//and (varint length, 4 byte little endian color) for each run
+void serializeColoredLine(std::string& out, const ColoredLine& line);
+
+//parse line serialized at in + pos and move pos past it, false if it's broken
+bool parseColoredLine(const char * in, std::size_t size, std::size_t& pos, ColoredLine& line);
+
+//wide lines that fell out of the hot scrollback of the model, lines are
+//numbered the same way as model numbers its' wide lines (counting from first
+//one ever echoed) and are gathered into blocks of kColdBlockBytes serialized
+//that get compressed once full, past a given count of blocks in memory the
+//oldest ones go into a temp file, blocks are only decompressed when lines from
+//them are asked for, which is when user scrolls to them, last two are cached
+
+class ColdScrollback
+{
+public:
+    ColdScrollback();
+
+    //closes the temp file
+    ~ColdScrollback();
+
+    //set how many lines to keep at most, 0 turns it off so push just drops lines
+    void setMaxLines(std::size_t lines);
+
+    //get how many lines are kept at most
+    std::size_t getMaxLines() const;
+
+    //set how many compressed blocks stay in memory, 0 means all of them do
+    void setMemoryBlocks(std::size_t blocks);
+
+    //get how many compressed blocks stay in memory
+    std::size_t getMemoryBlocks() const;
+
+    //add a line after the last one, its' number is getEnd() before the push
+    void push(const ColoredLine& line);
+
+    //number of the first line still kept
+    std::size_t getBegin() const;
+
+    //number one past the last line
+    std::size_t getEnd() const;
+
+    //get line by number, must be in [getBegin(), getEnd())
+    const ColoredLine& getLine(std::size_t line) const;
+
+    //drop all lines, the next pushed one gets number end
+    void clear(std::size_t end);
+
+private:
+    class Block
+    {
+    public:
+        std::size_t First; //number of first line in block
+        std::size_t Count; //how many lines are in the block
+        std::string Data; //compressed lines, empty when spilled
+        long SpillOffset; //where in temp file block is, if spilled
+        std::size_t SpillSize; //size of compressed data in temp file
+
+    };
+
+    class CacheEntry
+    {
+    public:
+        std::size_t First; //number of first line of cached block
+        std::vector<ColoredLine> Lines; //decompressed lines, empty if unused
+
+    };
+
+    //delete copy and assignment to forbid copying (we own a FILE)
+    ColdScrollback(const ColdScrollback& other);
+    ColdScrollback& operator=(const ColdScrollback& other);
+
+    void seal();
+    void spill();
+    void dropOldest();
+    void compactSpillFile();
+    bool loadBlock(const Block& block, std::vector<ColoredLine>& lines) const;
+
+    std::size_t m_maxlines; //how many lines we keep, 0 if off
+    std::size_t m_memblocks; //how many compressed blocks stay in memory, 0 for all
+    std::size_t m_begin; //number of first line kept
+    std::size_t m_end; //number one past the last line
+    std::deque<Block> m_blocks; //sealed blocks, oldest first
+    std::size_t m_spilled; //how many of the oldest blocks are in temp file
+    std::vector<ColoredLine> m_open; //lines of the block that's not sealed yet
+    std::string m_openraw; //m_open serialized, compressed as is on seal
+    std::FILE * m_spillfile; //temp file for spilled blocks, null until needed
+    long m_spillend; //end of data in temp file
+    long m_spilldead; //bytes in temp file of blocks that were dropped
+    mutable CacheEntry m_cache[2]; //last two decompressed blocks
+    mutable unsigned m_cachenext; //which cache entry to reuse next
+
+};
+
+} //priv
+} //blua
+
+#endif	/* LUACOLDSCROLLBACK_HPP */
+
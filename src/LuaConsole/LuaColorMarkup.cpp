@@ -0,0 +1,101 @@
+#include <LuaConsole/LuaColorMarkup.hpp>
+#include <algorithm>
+
+namespace blua {
+namespace priv {
+
+void applyColorSpans(const ColorSpan * spans, std::size_t count, std::size_t len,
+                     unsigned fill, ColorString& colors)
+{
+    colors.assign(len, fill);
+    for(std::size_t i = 0u; i < count; ++i)
+    {
+        if(spans[i].Start >= len)
+            continue;
+
+        const std::size_t end = spans[i].Start + std::min(spans[i].Length, len - spans[i].Start);
+        std::fill(colors.begin() + spans[i].Start, colors.begin() + end, spans[i].Color);
+    }
+}
+
+//value of hex digit c, or -1 if it's not one
+static int hexValue(char c)
+{
+    if(c >= '0' && c <= '9')
+        return c - '0';
+
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+//parse color tag at str (right after '{#'), returns its' length up to and
+//including the '}' or 0 if it's not a valid tag, color is only set if it is
+static std::size_t parseColorTag(const char * str, std::size_t len, unsigned fill, unsigned& color)
+{
+    std::size_t digits = 0u;
+    unsigned value = 0u;
+    while(digits < len && digits < 8u && hexValue(str[digits]) >= 0)
+        value = (value << 4) | hexValue(str[digits++]);
+
+    if(digits >= len || str[digits] != '}')
+        return 0u;
+
+    if(digits == 0u)
+        color = fill;
+    else if(digits == 6u)
+        color = (value << 8) | 0xffu;
+    else if(digits == 8u)
+        color = value;
+    else
+        return 0u;
+
+    return digits + 1u;
+}
+
+void parseColorMarkup(const char * str, std::size_t len, unsigned fill,
+                      std::string& text, ColorString& colors)
+{
+    text.clear();
+    colors.clear();
+
+    //plain text between tags is appended as a whole, with one fill of its' color
+    unsigned color = fill;
+    std::size_t start = 0u;
+    std::size_t i = 0u;
+    while(i < len)
+    {
+        if(str[i] != '{' || i + 1u >= len || (str[i + 1u] != '{' && str[i + 1u] != '#'))
+        {
+            ++i;
+            continue;
+        }
+
+        unsigned newcolor = color;
+        const std::size_t taglen = (str[i + 1u] == '{')?2u:parseColorTag(str + i + 2u, len - i - 2u, fill, newcolor);
+        if(taglen == 0u)
+        {
+            ++i;
+            continue;
+        }
+
+        //'{{' keeps its' first brace as text
+        const std::size_t textend = (str[i + 1u] == '{')?(i + 1u):i;
+        text.append(str + start, textend - start);
+        colors.append(textend - start, color);
+        color = newcolor;
+        i += (str[i + 1u] == '{')?2u:(taglen + 2u);
+        start = i;
+    }
+
+    text.append(str + start, len - start);
+    colors.append(len - start, color);
+}
+
+} //priv
+} //blua
+
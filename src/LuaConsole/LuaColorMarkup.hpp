@@ -0,0 +1,26 @@
+#ifndef LUACOLORMARKUP_HPP
+#define	LUACOLORMARKUP_HPP
+
+#include <LuaConsole/LuaConsoleModel.hpp>
+
+namespace blua {
+namespace priv {
+
+//set colors to len chars of fill with each of count spans painted over it in
+//its' color, spans that go past len are cut and later spans win over earlier
+//ones, each span is a single fill of its' run, nothing is looked at per char
+void applyColorSpans(const ColorSpan * spans, std::size_t count, std::size_t len,
+                     unsigned fill, ColorString& colors);
+
+//strip color markup from len chars at str into text, with colors of its' chars
+//in colors, '{#rrggbb}' or '{#rrggbbaa}' (hex) switches to that color, '{#}'
+//back to fill and '{{' is a single '{', anything else is kept as it is
+//text and colors are cleared first, so they can be reused between calls
+void parseColorMarkup(const char * str, std::size_t len, unsigned fill,
+                      std::string& text, ColorString& colors);
+
+} //priv
+} //blua
+
+#endif	/* LUACOLORMARKUP_HPP */
+
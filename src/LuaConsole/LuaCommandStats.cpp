@@ -0,0 +1,225 @@
+#include <LuaConsole/LuaCommandStats.hpp>
+#include <LuaConsole/LuaHeader.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace blua {
+namespace priv {
+
+#ifdef _WIN32
+
+double getWallSeconds()
+{
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return static_cast<double>(now.QuadPart) / static_cast<double>(freq.QuadPart);
+}
+
+double getThreadCpuSeconds()
+{
+    FILETIME creation, exit, kernel, user;
+    if(!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0.0;
+
+    //both are in 100 nanosecond units
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (static_cast<double>(k.QuadPart) + static_cast<double>(u.QuadPart)) * 1e-7;
+}
+
+#else //_WIN32
+
+static double readClock(clockid_t clock)
+{
+    struct timespec ts;
+    if(clock_gettime(clock, &ts) != 0)
+        return 0.0;
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double getWallSeconds()
+{
+    return readClock(CLOCK_MONOTONIC);
+}
+
+double getThreadCpuSeconds()
+{
+    return readClock(CLOCK_THREAD_CPUTIME_ID);
+}
+
+#endif //_WIN32
+
+double getLuaMemory(lua_State * L)
+{
+    return lua_gc(L, LUA_GCCOUNT, 0) * 1024.0 + lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+void clearHistogram(StatsHistogram& hist)
+{
+    hist.Count = 0u;
+    hist.Sum = 0.0;
+    hist.Min = 0.0;
+    hist.Max = 0.0;
+    for(unsigned i = 0u; i < kStatsBucketCount; ++i)
+        hist.Buckets[i] = 0u;
+}
+
+void addToHistogram(StatsHistogram& hist, double value, double unit)
+{
+    hist.Min = (hist.Count == 0u || value < hist.Min)?value:hist.Min;
+    hist.Max = (hist.Count == 0u || value > hist.Max)?value:hist.Max;
+    hist.Sum += value;
+    ++hist.Count;
+
+    //scaled value is mantissa * 2^exp with mantissa in [0.5, 1), so values
+    //from 2^(i-1) to 2^i have exp of i and those under 1 go to bucket 0
+    const double scaled = value * unit;
+    int exp = 0;
+    if(scaled >= 1.0)
+        std::frexp(scaled, &exp);
+
+    hist.Buckets[std::min<unsigned>(exp, kStatsBucketCount - 1u)] += 1u;
+}
+
+//address of this is the registry key of the cycle counter userdata
+static char gcCounterKey;
+
+//make a userdata with metatable at index meta that nothing refers to
+static void newGcSentinel(lua_State * L, int meta)
+{
+    lua_newuserdata(L, 1u);
+    lua_pushvalue(L, meta);
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
+}
+
+//__gc of sentinels, upvalues are the counter and sentinel metatable
+static int collectGcSentinel(lua_State * L)
+{
+    ++*static_cast<std::size_t*>(lua_touserdata(L, lua_upvalueindex(1)));
+    newGcSentinel(L, lua_upvalueindex(2));
+    return 0;
+}
+
+void installGcCounter(lua_State * L)
+{
+    lua_pushlightuserdata(L, &gcCounterKey);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    const bool installed = !lua_isnil(L, -1);
+    lua_pop(L, 1);
+    if(installed)
+        return;
+
+    std::size_t * count = static_cast<std::size_t*>(lua_newuserdata(L, sizeof(std::size_t)));
+    *count = 0u;
+    lua_pushlightuserdata(L, &gcCounterKey);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    //__gc has to be in metatable before it's set for 5.2 and 5.3 to call it
+    lua_newtable(L);
+    lua_pushvalue(L, -2);
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, &collectGcSentinel, 2);
+    lua_setfield(L, -2, "__gc");
+    newGcSentinel(L, lua_gettop(L));
+    lua_pop(L, 2);
+}
+
+std::size_t getGcCycles(lua_State * L)
+{
+    lua_pushlightuserdata(L, &gcCounterKey);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    const void * count = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return count?*static_cast<const std::size_t*>(count):0u;
+}
+
+//print seconds with unit that keeps them short
+static int formatSeconds(char * buff, double seconds)
+{
+    if(seconds < 1e-3)
+        return std::sprintf(buff, "%.1f us", seconds * 1e6);
+
+    if(seconds < 1.0)
+        return std::sprintf(buff, "%.2f ms", seconds * 1e3);
+
+    return std::sprintf(buff, "%.2f s", seconds);
+}
+
+//print bytes with unit that keeps them short, without sign
+static int formatBytes(char * buff, double bytes)
+{
+    const double kb = std::fabs(bytes) / 1024.0;
+    if(kb < 1024.0)
+        return std::sprintf(buff, "%.1f KB", kb);
+
+    return std::sprintf(buff, "%.1f MB", kb / 1024.0);
+}
+
+std::string formatCommandStats(const CommandStats& stats)
+{
+    char buff[200];
+    char * at = buff;
+    at += std::sprintf(at, "compile ");
+    at += formatSeconds(at, stats.Values[ECM_COMPILE]);
+    at += std::sprintf(at, ", run ");
+    at += formatSeconds(at, stats.Values[ECM_WALL]);
+    at += std::sprintf(at, ", cpu ");
+    at += formatSeconds(at, stats.Values[ECM_CPU]);
+
+    const double memory = stats.Values[ECM_MEMORY];
+    at += std::sprintf(at, ", memory %c", (memory < 0.0)?'-':'+');
+    at += formatBytes(at, memory);
+    std::sprintf(at, ", gc %.0f", stats.Values[ECM_GC_CYCLES]);
+    return buff;
+}
+
+void formatIdleGcStats(const IdleGcStats& stats, double memory, double growth, bool suppressed, std::vector<std::string>& rows)
+{
+    char buff[200];
+    char * at = buff;
+    at += std::sprintf(at, "gc: ");
+    at += formatBytes(at, memory);
+    at += std::sprintf(at, " in use, %c", (growth < 0.0)?'-':'+');
+    at += formatBytes(at, growth);
+    std::sprintf(at, " since last cycle, automatic collection %s", suppressed?"stopped":"on");
+    rows.push_back(buff);
+
+    const StatsHistogram& steps = stats.Steps;
+    at = buff;
+    at += std::sprintf(at, "idle: %lu calls, %lu steps", static_cast<unsigned long>(stats.Calls),
+                       static_cast<unsigned long>(steps.Count));
+    if(steps.Count > 0u)
+    {
+        at += std::sprintf(at, " (avg ");
+        at += formatSeconds(at, steps.Sum / steps.Count);
+        at += std::sprintf(at, ", max ");
+        at += formatSeconds(at, steps.Max);
+        at += std::sprintf(at, ")");
+    }
+    at += std::sprintf(at, ", last ");
+    at += formatSeconds(at, stats.LastSeconds);
+    at += std::sprintf(at, ", overrun ");
+    formatSeconds(at, stats.MaxOverrun);
+    rows.push_back(buff);
+
+    std::sprintf(buff, "cycles: %lu finished by idle, %lu by others", static_cast<unsigned long>(stats.Cycles),
+                 static_cast<unsigned long>(stats.OtherCycles));
+    rows.push_back(buff);
+}
+
+} //priv
+} //blua
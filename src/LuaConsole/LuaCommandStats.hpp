@@ -0,0 +1,46 @@
+#ifndef LUACOMMANDSTATS_HPP
+#define	LUACOMMANDSTATS_HPP
+
+#include <LuaConsole/LuaConsoleModel.hpp>
+#include <string>
+#include <vector>
+
+namespace blua {
+namespace priv {
+
+//seconds from some fixed point in the past, only differences mean anything
+double getWallSeconds();
+
+//seconds of cpu time the calling thread used so far, other threads of the
+//process (like audio or loaders of the host) don't count
+double getThreadCpuSeconds();
+
+//bytes lua says it's using, per lua_gc count
+double getLuaMemory(lua_State * L);
+
+//make histogram empty
+void clearHistogram(StatsHistogram& hist);
+
+//add value to histogram, it's multiplied by unit to pick the bucket
+void addToHistogram(StatsHistogram& hist, double value, double unit);
+
+//put a sentinel userdata with __gc into L that counts each garbage
+//collection cycle that finishes (by getting collected and making a new one),
+//does nothing if L has one already
+void installGcCounter(lua_State * L);
+
+//get how many garbage collection cycles finished since installGcCounter
+std::size_t getGcCycles(lua_State * L);
+
+//make a short line describing stats, to show after a command
+std::string formatCommandStats(const CommandStats& stats);
+
+//append rows describing idle collection stats to rows, memory is lua memory
+//in use and growth is how much it grew since the last finished cycle
+void formatIdleGcStats(const IdleGcStats& stats, double memory, double growth, bool suppressed, std::vector<std::string>& rows);
+
+} //priv
+} //blua
+
+#endif	/* LUACOMMANDSTATS_HPP */
+
@@ -0,0 +1,150 @@
+#include <LuaConsole/LuaCompress.hpp>
+#include <cstring>
+#include <vector>
+
+namespace blua {
+namespace priv {
+
+//shortest match worth encoding
+const std::size_t kMinMatch = 4u;
+
+//log2 of how many positions hash table remembers
+const unsigned kHashBits = 12u;
+
+inline static unsigned hashAt(const char * p)
+{
+    unsigned v;
+    std::memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32u - kHashBits);
+}
+
+//length past the nibble in the token is written as 255s and a remainder
+static void putLength(std::string& out, std::size_t len)
+{
+    while(len >= 255u)
+    {
+        out += static_cast<char>(255);
+        len -= 255u;
+    }
+    out += static_cast<char>(len);
+}
+
+static bool getLength(const std::string& in, std::size_t& pos, std::size_t& len)
+{
+    unsigned char c;
+    do
+    {
+        if(pos >= in.size())
+            return false;
+
+        c = static_cast<unsigned char>(in[pos++]);
+        len += c;
+    }
+    while(c == 255u);
+    return true;
+}
+
+static void putSequence(std::string& out, const char * lits, std::size_t litlen, std::size_t offset, std::size_t matchlen)
+{
+    const std::size_t m = matchlen?matchlen - kMinMatch:0u;
+    const unsigned token = ((litlen < 15u?litlen:15u) << 4) | (m < 15u?m:15u);
+    out += static_cast<char>(token);
+    if(litlen >= 15u)
+        putLength(out, litlen - 15u);
+
+    out.append(lits, litlen);
+
+    //last sequence is literals only and has no offset
+    if(!matchlen)
+        return;
+
+    out += static_cast<char>(offset & 0xff);
+    out += static_cast<char>(offset >> 8);
+    if(m >= 15u)
+        putLength(out, m - 15u);
+}
+
+bool compressBlock(const std::string& in, std::string& out)
+{
+    out.clear();
+    if(in.size() > kMaxCompressInput)
+        return false;
+
+    const char * src = in.data();
+    const std::size_t size = in.size();
+    std::vector<unsigned> table(1u << kHashBits, 0u); //position + 1, 0 is empty
+
+    std::size_t anchor = 0u; //start of literals not yet written
+    std::size_t i = 0u;
+    while(i + kMinMatch <= size)
+    {
+        const unsigned h = hashAt(src + i);
+        const std::size_t cand = table[h];
+        table[h] = i + 1u;
+
+        if(cand == 0u || std::memcmp(src + cand - 1u, src + i, kMinMatch) != 0)
+        {
+            ++i;
+            continue;
+        }
+
+        const std::size_t from = cand - 1u;
+        std::size_t len = kMinMatch;
+        while(i + len < size && src[from + len] == src[i + len])
+            ++len;
+
+        putSequence(out, src + anchor, i - anchor, i - from, len);
+        i += len;
+        anchor = i;
+    }
+
+    putSequence(out, src + anchor, size - anchor, 0u, 0u);
+    return true;
+}
+
+bool decompressBlock(const std::string& in, std::string& out)
+{
+    out.clear();
+    std::size_t pos = 0u;
+    while(pos < in.size())
+    {
+        const unsigned token = static_cast<unsigned char>(in[pos++]);
+        std::size_t litlen = token >> 4;
+        if(litlen == 15u && !getLength(in, pos, litlen))
+            return false;
+
+        if(in.size() - pos < litlen)
+            return false;
+
+        out.append(in, pos, litlen);
+        pos += litlen;
+
+        //no offset after literals means it was the last sequence
+        if(pos == in.size())
+            return true;
+
+        if(in.size() - pos < 2u)
+            return false;
+
+        const std::size_t offset = static_cast<unsigned char>(in[pos]) |
+                (static_cast<unsigned char>(in[pos + 1u]) << 8);
+        pos += 2u;
+
+        std::size_t matchlen = token & 15u;
+        if(matchlen == 15u && !getLength(in, pos, matchlen))
+            return false;
+
+        matchlen += kMinMatch;
+        if(offset == 0u || offset > out.size())
+            return false;
+
+        //byte by byte since match may overlap what it's copying
+        const std::size_t from = out.size() - offset;
+        for(std::size_t j = 0u; j < matchlen; ++j)
+            out += out[from + j];
+    }
+    return true;
+}
+
+} //priv
+} //blua
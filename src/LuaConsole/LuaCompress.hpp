@@ -0,0 +1,27 @@
+#ifndef LUACOMPRESS_HPP
+#define	LUACOMPRESS_HPP
+
+#include <string>
+
+namespace blua {
+namespace priv {
+
+//byte oriented LZ77 in the spirit of LZ4: greedy matching through a small hash
+//table of last positions, a token byte with literal and match length nibbles,
+//literals copied as is and 2 byte match offsets, so input can't be over 64 KiB
+//it's meant to be fast rather than good, console text compresses well anyway
+
+//biggest input compressBlock accepts
+const std::size_t kMaxCompressInput = 65535u;
+
+//compress in and put the result in out, returns false if in is too big
+bool compressBlock(const std::string& in, std::string& out);
+
+//decompress in and put the result in out, returns false if in is malformed
+bool decompressBlock(const std::string& in, std::string& out);
+
+} //priv
+} //blua
+
+#endif	/* LUACOMPRESS_HPP */
+
@@ -0,0 +1,203 @@
+#include <LuaConsole/LuaConsoleAllocator.hpp>
+#include <LuaConsole/LuaHeader.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace blua {
+
+//size classes are multiples of this, up to kSizeClassCount times it
+const std::size_t kSizeClassStep = 16u;
+const std::size_t kSizeClassCount = 16u;
+const std::size_t kMaxPooledSize = kSizeClassStep * kSizeClassCount;
+
+//size of a page that gets carved into blocks of one size class
+const std::size_t kPageSize = 16u * 1024u;
+
+//index of the smallest size class that fits size, size must be 1 to kMaxPooledSize
+inline static std::size_t getSizeClass(std::size_t size)
+{
+    return (size - 1u) / kSizeClassStep;
+}
+
+LuaConsoleAllocator::LuaConsoleAllocator() :
+m_limit(0u),
+m_live(0u),
+m_peak(0u),
+m_allocs(0u),
+m_frees(0u),
+m_failed(0u)
+{
+    for(std::size_t i = 0u; i < kSizeClassCount; ++i)
+        m_free[i] = 0x0;
+}
+
+LuaConsoleAllocator::~LuaConsoleAllocator()
+{
+    for(std::size_t i = 0u; i < m_pages.size(); ++i)
+        std::free(m_pages[i]);
+}
+
+void * LuaConsoleAllocator::alloc(void * ud, void * ptr, std::size_t osize, std::size_t nsize)
+{
+    LuaConsoleAllocator * self = static_cast<LuaConsoleAllocator*>(ud);
+
+    //5.2 and 5.3 pass the kind of object in osize when there's no block yet
+    if(!ptr)
+        osize = 0u;
+
+    if(nsize == 0u)
+    {
+        if(ptr)
+        {
+            self->deallocate(ptr, osize);
+            self->m_live -= osize;
+            ++self->m_frees;
+        }
+        return 0x0;
+    }
+
+    //only growing can fail, lua 5.1 assumes shrinking never does
+    if(nsize > osize && self->m_limit != 0u && self->m_live + (nsize - osize) > self->m_limit)
+    {
+        ++self->m_failed;
+        return 0x0;
+    }
+
+    void * ret = ptr?self->reallocate(ptr, osize, nsize):self->allocate(nsize);
+    if(!ret)
+    {
+        ++self->m_failed;
+        return 0x0;
+    }
+
+    self->m_live = self->m_live - osize + nsize;
+    self->m_peak = std::max(self->m_peak, self->m_live);
+    self->m_allocs += !ptr;
+    return ret;
+}
+
+lua_State * LuaConsoleAllocator::newState()
+{
+    return lua_newstate(&LuaConsoleAllocator::alloc, this);
+}
+
+void LuaConsoleAllocator::setLimit(std::size_t bytes)
+{
+    m_limit = bytes;
+}
+
+std::size_t LuaConsoleAllocator::getLimit() const
+{
+    return m_limit;
+}
+
+std::size_t LuaConsoleAllocator::getLiveBytes() const
+{
+    return m_live;
+}
+
+std::size_t LuaConsoleAllocator::getPeakBytes() const
+{
+    return m_peak;
+}
+
+void LuaConsoleAllocator::resetPeak()
+{
+    m_peak = m_live;
+}
+
+std::size_t LuaConsoleAllocator::getLiveBlocks() const
+{
+    return m_allocs - m_frees;
+}
+
+std::size_t LuaConsoleAllocator::getAllocationCount() const
+{
+    return m_allocs;
+}
+
+std::size_t LuaConsoleAllocator::getFreeCount() const
+{
+    return m_frees;
+}
+
+std::size_t LuaConsoleAllocator::getFailedCount() const
+{
+    return m_failed;
+}
+
+std::size_t LuaConsoleAllocator::getPooledBytes() const
+{
+    return m_pages.size() * kPageSize;
+}
+
+void * LuaConsoleAllocator::allocate(std::size_t size)
+{
+    if(size > kMaxPooledSize)
+        return std::malloc(size);
+
+    const std::size_t sizeclass = getSizeClass(size);
+    if(!m_free[sizeclass] && !refill(sizeclass))
+        return 0x0;
+
+    //each free block starts with pointer to the next one
+    void * ret = m_free[sizeclass];
+    m_free[sizeclass] = *static_cast<void**>(ret);
+    return ret;
+}
+
+void LuaConsoleAllocator::deallocate(void * ptr, std::size_t size)
+{
+    if(size > kMaxPooledSize)
+        return std::free(ptr);
+
+    const std::size_t sizeclass = getSizeClass(size);
+    *static_cast<void**>(ptr) = m_free[sizeclass];
+    m_free[sizeclass] = ptr;
+}
+
+void * LuaConsoleAllocator::reallocate(void * ptr, std::size_t osize, std::size_t nsize)
+{
+    //both big, realloc might not even have to move it
+    if(osize > kMaxPooledSize && nsize > kMaxPooledSize)
+    {
+        void * ret = std::realloc(ptr, nsize);
+        return (ret || nsize > osize)?ret:ptr;
+    }
+
+    //same class, block already fits, this is how most table and string
+    //buffer growth in small steps goes
+    if(osize != 0u && osize <= kMaxPooledSize && nsize <= kMaxPooledSize &&
+       getSizeClass(osize) == getSizeClass(nsize))
+        return ptr;
+
+    void * ret = allocate(nsize);
+    if(!ret)
+    {
+        //shrinking must not fail so keep the old block, it's big enough, at
+        //worst a big one later lands in a free list (and is never freed)
+        return (nsize < osize)?ptr:0x0;
+    }
+
+    std::memcpy(ret, ptr, std::min(osize, nsize));
+    deallocate(ptr, osize);
+    return ret;
+}
+
+//carve a new page into free blocks of sizeclass
+bool LuaConsoleAllocator::refill(std::size_t sizeclass)
+{
+    char * page = static_cast<char*>(std::malloc(kPageSize));
+    if(!page)
+        return false;
+
+    m_pages.push_back(page);
+    const std::size_t size = (sizeclass + 1u) * kSizeClassStep;
+    for(std::size_t off = 0u; off + size <= kPageSize; off += size)
+        deallocate(page + off, size);
+
+    return true;
+}
+
+} //blua
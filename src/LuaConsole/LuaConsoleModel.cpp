@@ -1,11 +1,35 @@
 #include <LuaConsole/LuaConsoleModel.hpp>
+#include <LuaConsole/LuaConsoleAllocator.hpp>
 #include <LuaConsole/LuaHeader.hpp>
 #include <LuaConsole/LuaCompletion.hpp>
+#include <LuaConsole/LuaHistoryIndex.hpp>
+#include <LuaConsole/LuaHistoryJournal.hpp>
+#include <LuaConsole/LuaOutputCapture.hpp>
+#include <LuaConsole/LuaTextSearch.hpp>
+#include <LuaConsole/LuaColdScrollback.hpp>
+#include <LuaConsole/LuaScrollbackFile.hpp>
+#include <LuaConsole/LuaPrettyPrint.hpp>
+#include <LuaConsole/LuaInspector.hpp>
+#include <LuaConsole/LuaColorMarkup.hpp>
+#include <LuaConsole/LuaCommandStats.hpp>
+#include <LuaConsole/LuaProfiler.hpp>
+#include <LuaConsole/LuaBenchmark.hpp>
 #include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdlib>
+#include <cctype>
 #include <algorithm>
 #include <sstream>
 #include <fstream>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace blua {
 
 //how wide is console -- this has to be adjustable later
@@ -28,8 +52,30 @@ const int kDefaultHistorySize = 100;
 //how many messages(not wide) to keep, this is for internal workings of console mostly
 const int kMessagesKeptCount = 3000;
 
+//lua strings at least this long are pinned in registry instead of copied by echo
+const std::size_t kPinnedMinSize = 4096u;
+
+//output buffer is flushed as soon as it gets this big, even in the middle of a command
+const std::size_t kOutputFlushSize = 64u * 1024u;
+
 const char * const kHistoryFilename = "luaconsolehistory.txt";
 const char * const kInitFilename = "luaconsoleinit.lua";
+const char * const kScrollbackFilename = "luaconsolescrollback.bin";
+
+//default limits of printing returned values
+const std::size_t kDefaultPrintDepth = 4u;
+const std::size_t kDefaultPrintItems = 100u;
+const std::size_t kDefaultPrintBytes = 64u * 1024u;
+
+//how many last lines of scrollback file to keep by default
+const std::size_t kDefaultScrollbackFileLines = 100000u;
+
+//color of echoChannel messages of each severity, indexed by ECONSOLE_SEVERITY
+const ECONSOLE_COLOR kSeverityColors[] = {ECC_EVAL, ECC_EVAL, ECC_ECHO, ECC_WARNING, ECC_ERROR};
+
+//what prompt line starts with during reverse history search
+const char * const kSearchPrompt = "(reverse-i-search)`";
+const char * const kFailedSearchPrompt = "(failed reverse-i-search)`";
 
 //default skipable chars, very sane for lua and similar to bash
 const char * const kDefaultSkipChars = " ,.;()[]{}:'\"";
@@ -110,11 +156,52 @@ LuaConsoleModel* LuaConsoleModel::checkFromRegistry(lua_State* L)
     return ret;
 }
 
+LuaConsoleModel* LuaConsoleModel::getFromUpvalue(lua_State* L)
+{
+    //upvalue of a function that has none is not valid, so this gives null then
+    void * ptr = lua_touserdata(L, lua_upvalueindex(1));
+    return ptr?*static_cast<LuaConsoleModel**>(ptr):0x0;
+}
+
+LuaConsoleModel* LuaConsoleModel::checkFromUpvalue(lua_State* L)
+{
+    LuaConsoleModel * ret = getFromUpvalue(L);
+    if(!ret)
+        luaL_error(L, "LuaConsole not attached to this state");
+
+    return ret;
+}
+
+bool LuaConsoleModel::pushClosure(LuaCFunction func)
+{
+    if(!L)
+        return false;
+
+    lua_pushlightuserdata(L, getLightKey());
+    lua_gettable(L, LUA_REGISTRYINDEX);
+    lua_pushcclosure(L, func, 1);
+    return true;
+}
+
 LuaConsoleModel::LuaConsoleModel(unsigned options) :
 m_dirtyness(1u), //because 0u is what view starts at
 m_lastupdate(0u),
 m_cur(1),
 L(0x0),
+m_hstart(0u),
+m_hsize(0u),
+m_hnext(0u),
+m_hsearchindex(new priv::HistoryIndex),
+m_hprefixtrie(new priv::HistoryTrie),
+m_hsuggest(true),
+m_hjournal(new priv::HistoryJournal),
+m_hindexdirty(false),
+m_hlastprune(0u),
+m_hignoredups(false),
+m_searching(false),
+m_searchfailed(false),
+m_searchmatch(0u),
+m_hindex(0),
 m_w(kInnerWidth),
 m_empty(),
 m_options(options),
@@ -123,9 +210,33 @@ m_emptyenterrepeat(true),
 m_skipchars(kDefaultSkipChars),
 m_firstmsg(0),
 m_printeval(true),
+m_printdepth(kDefaultPrintDepth),
+m_printitems(kDefaultPrintItems),
+m_printbytes(kDefaultPrintBytes),
+m_inspect(false),
+m_inspector(new priv::Inspector),
 m_addreturn(true),
 m_commentcommands(true),
-m_lastlineoffset(0u)
+m_lastlineoffset(0u),
+m_widedropped(0u),
+m_curmatch(0u),
+m_cold(new priv::ColdScrollback),
+m_sbfile(new priv::ScrollbackFile),
+m_sbfilelines(kDefaultScrollbackFileLines),
+m_collapserepeats(false),
+m_batchdepth(0u),
+m_batchechoed(false),
+m_unwrapped(0u),
+m_formatbuff(256u),
+m_redirectoutput(options & ECO_REDIRECT_OUTPUT),
+m_capture(new priv::OutputCapture),
+m_cmdmemlimit(0u),
+m_showstats(false),
+m_profiler(new priv::Profiler),
+m_suppressgc(false),
+m_gcbase(0.0),
+m_gcincycle(false),
+m_gccycles(0u)
 {
     for(int i = 0; i < 24 * 80; ++i)
     {
@@ -164,15 +275,31 @@ m_lastlineoffset(0u)
     m_colors[ECC_CURSOR] = 0x00ffffff;
     m_colors[ECC_EVAL] = 0xa9a9a9ff;
     m_colors[ECC_HISTORY] = 0xb8860bff;
+    m_colors[ECC_SUGGESTION] = 0x808080ff;
+    m_colors[ECC_MATCH] = 0xff00ffff;
+    m_colors[ECC_WARNING] = 0xffa500ff;
+    m_colors[ECC_STATS] = 0x696969ff;
+
+    for(unsigned i = 0u; i < kChannelCount; ++i)
+        m_channelseverity[i] = ECS_INFO;
+
+    resetCommandStats();
+    resetIdleGcStats();
 
-    //always give sane history size default, even if not asked for reading it
-    setHistorySize(kDefaultHistorySize);
+    //always give sane history capacity default, even if not asked for reading it
+    setHistoryCapacity(kDefaultHistorySize);
 
     //read history from file if desired
     if(m_options & ECO_HISTORY)
         loadHistoryFromFile(kHistoryFilename);
 
-    m_hindex = m_history.size();
+    if((m_options & ECO_HISTORY) && (m_options & ECO_HISTORY_JOURNAL))
+        openHistoryJournal(kHistoryFilename);
+
+    if(m_options & ECO_SCROLLBACK_FILE)
+        openScrollbackFile(kScrollbackFilename);
+
+    m_hindex = getHistorySize();
 
     for(int i = 0; i < ECALLBACK_TYPE_COUNT; ++i)
     {
@@ -183,13 +310,36 @@ m_lastlineoffset(0u)
 
 LuaConsoleModel::~LuaConsoleModel()
 {
-    //save history to file if desired, append
-    if(m_options & ECO_HISTORY)
+    //save history to file if desired, unless journal has been doing it all along
+    if((m_options & ECO_HISTORY) && !isHistoryJournalOpen())
         saveHistoryToFile(kHistoryFilename, false);
+
+    delete m_hjournal;
+    delete m_hsearchindex;
+    delete m_hprefixtrie;
+    delete m_cold;
+    delete m_sbfile;
+    delete m_capture;
+
+    if(L)
+    {
+        m_inspector->clear(L);
+        m_profiler->stop(L);
+        if(m_suppressgc)
+            lua_gc(L, LUA_GCRESTART, 0);
+
+        unpinMessages(false);
+    }
+
+    delete m_inspector;
+    delete m_profiler;
 }
 
 void LuaConsoleModel::moveCursor(int move)
 {
+    if(m_searching)
+        stopHistorySearch(true);
+
     m_cur += move;
     m_cur = std::max<int>(m_cur, 1);
     m_cur = std::min<int>(m_lastline.size() + 1, m_cur);
@@ -202,13 +352,30 @@ void LuaConsoleModel::scrollLines(int amount)
     m_firstmsg += amount;
 
     //below code ensures we go no further than last or first line
-    m_firstmsg = std::max(m_firstmsg, 21 - static_cast<int>(m_widemsg.size()));
+    m_firstmsg = std::max(m_firstmsg, 21 - static_cast<int>(getWideLineCount()));
     m_firstmsg = std::min(m_firstmsg, 0);
     ++m_dirtyness;
 }
 
+bool LuaConsoleModel::acceptSuggestion()
+{
+    if(m_searching || static_cast<std::size_t>(m_cur) != m_lastline.size() + 1u)
+        return false;
+
+    const std::string * suggestion = findSuggestion();
+    if(!suggestion)
+        return false;
+
+    m_lastline = *suggestion;
+    moveCursor(kCursorEnd);
+    return true;
+}
+
 void LuaConsoleModel::moveCursorOneWord(EMOVE_DIRECTION move)
 {
+    if(m_searching)
+        stopHistorySearch(true);
+
     const int iter = (move == EMD_LEFT)?-1:1;
 
     //see below about why we do 'm_cur - 1' not just 'm_cur'
@@ -235,13 +402,23 @@ void LuaConsoleModel::moveCursorOneWord(EMOVE_DIRECTION move)
 
 void LuaConsoleModel::readHistory(int change)
 {
-    const bool waspromp = static_cast<std::size_t>(m_hindex) == m_history.size();
+    if(m_searching)
+        stopHistorySearch(true);
+
+    //only pick up lines from journal when not in the middle of browsing
+    if(static_cast<std::size_t>(m_hindex) == getHistorySize())
+    {
+        pollHistoryJournal();
+        m_hindex = getHistorySize();
+    }
+
+    const bool waspromp = static_cast<std::size_t>(m_hindex) == getHistorySize();
 
     m_hindex += change;
     m_hindex = std::max<int>(m_hindex, 0);
-    m_hindex = std::min<int>(m_hindex, m_history.size());
+    m_hindex = std::min<int>(m_hindex, getHistorySize());
 
-    if(static_cast<std::size_t>(m_hindex) == m_history.size())
+    if(static_cast<std::size_t>(m_hindex) == getHistorySize())
     {
         //if we came back from history, swap last line in
         if(!waspromp)
@@ -256,7 +433,7 @@ void LuaConsoleModel::readHistory(int change)
         if(waspromp)
             std::swap(m_lastline, m_savedlastline);
 
-        m_lastline = m_history[m_hindex];
+        m_lastline = getHistoryItem(m_hindex);
         m_lastlineoffset = 0u;
         moveCursor(kCursorEnd);
     }
@@ -264,31 +441,78 @@ void LuaConsoleModel::readHistory(int change)
     ++m_dirtyness;
 }
 
+namespace priv {
+
+//where printed lines of returned values go
+
+class PrintTarget
+{
+public:
+    LuaConsoleModel * Model;
+    unsigned Color;
+
+};
+
+} //priv
+
+static void echoPrintedLine(const std::string& line, void * data)
+{
+    const priv::PrintTarget * target = static_cast<const priv::PrintTarget*>(data);
+    target->Model->echoColored(line, target->Color);
+}
+
 void LuaConsoleModel::printLuaStackInColor(int first, int last, unsigned color)
 {
-    std::stringstream ss;
+    //we pretty print just the way tostring lua call does, except for tables
+    priv::PrintTarget target;
+    target.Model = this;
+    target.Color = color;
+    priv::PrettyPrinter printer(L, &echoPrintedLine, &target, m_printdepth, m_printitems, m_printbytes);
+    for(int i = first; i <= last; ++i)
+    {
+        printer.print(i);
+        printer.printSeparator();
+    }
+    printer.finish();
+}
+
+void LuaConsoleModel::inspectLuaStack(int first, int last, unsigned color)
+{
+    priv::PrintTarget target;
+    target.Model = this;
+    target.Color = color;
     for(int i = first; i <= last; ++i)
     {
-        //we pretty print just the way tostring lua call does
-        switch(lua_type(L, i))
+        if(lua_type(L, i) == LUA_TTABLE)
         {
-            case LUA_TNUMBER:
-            case LUA_TSTRING:
-                ss << lua_tostring(L, i);
-                break;
-            case LUA_TBOOLEAN:
-                ss << (lua_toboolean(L, i)?"true":"false");
-                break;
-            case LUA_TNIL:
-                ss << "nil";
-                break;
-            default:
-                ss << luaL_typename(L, i) << ": " << lua_topointer(L, i);
-                break;
-        } //switch lua type i
-        ss << ' ';
-    }//for i = first to last
-    echoColored(ss.str(), color);
+            echoInspectedPage(m_inspector->add(L, i), true);
+            continue;
+        }
+
+        priv::PrettyPrinter printer(L, &echoPrintedLine, &target, 0u, 0u, m_printbytes);
+        printer.print(i);
+        printer.finish();
+    }
+}
+
+void LuaConsoleModel::echoInspectedPage(unsigned id, bool restart)
+{
+    std::ostringstream ss;
+    std::vector<std::string> rows;
+    if(!L || !m_inspector->has(id))
+    {
+        ss << "No inspected table with id " << id;
+        return echoColored(ss.str(), m_colors[ECC_ERROR]);
+    }
+
+    if(!m_inspector->page(L, id, restart, rows))
+    {
+        ss << "Table " << id << " changed since last page, --open " << id << " to start over";
+        return echoColored(ss.str(), m_colors[ECC_ERROR]);
+    }
+
+    for(std::size_t i = 0u; i < rows.size(); ++i)
+        echoColored(rows[i], m_colors[ECC_EVAL]);
 }
 
 //NOTE: we can't do dostring here because we would confuse runtime and parse
@@ -300,43 +524,89 @@ void LuaConsoleModel::printLuaStackInColor(int first, int last, unsigned color)
 //be parse error which is wrong, because we want concat error from return
 //added version then
 
-bool LuaConsoleModel::tryEval(bool addreturn)
+//get the allocator of L if it was made with LuaConsoleAllocator, else null
+static LuaConsoleAllocator * getConsoleAllocator(lua_State * L)
+{
+    void * ud;
+    if(lua_getallocf(L, &ud) != &LuaConsoleAllocator::alloc)
+        return 0x0;
+
+    return static_cast<LuaConsoleAllocator*>(ud);
+}
+
+int LuaConsoleModel::tryEval(bool addreturn)
 {
     if(addreturn)
     {
         const std::string code = "return " + m_buffcmd;
-        if(BLA_LUA_OK == luaL_loadstring(L, code.c_str()))
-        {
-            return true;
-        }
-        else
-        {
+        const int status = luaL_loadstring(L, code.c_str());
+        if(BLA_LUA_OK != status)
             lua_pop(L, 1); //pop error - it doesn't matter with added return
-            return false;
-        }
+
+        return status;
     } //if addreturn
     else
     {
-        return BLA_LUA_OK == luaL_loadstring(L, m_buffcmd.c_str());
+        return luaL_loadstring(L, m_buffcmd.c_str());
     }
 }
 
+namespace priv {
+
+//keeps a batch of echoes open for as long as it lives
+
+class EchoBatch
+{
+public:
+    explicit EchoBatch(LuaConsoleModel& model) : m_model(model)
+    {
+        m_model.beginBatch();
+    }
+
+    ~EchoBatch()
+    {
+        m_model.endBatch();
+    }
+
+private:
+    LuaConsoleModel& m_model;
+
+};
+
+} //priv
+
 ELINE_PARSE_RESULT LuaConsoleModel::parseLastLine()
 {
+    //a command might echo a lot, only wrap and scroll once it's done
+    const priv::EchoBatch batch(*this);
+
     ELINE_PARSE_RESULT ret = ELPR_OK;
-    if(m_lastline.size() == 0u && m_emptyenterrepeat && !m_history.empty())
-        m_lastline = m_history.back();
+    if(m_searching)
+        stopHistorySearch(true);
+
+    if(L)
+        releaseDroppedPins(L);
+
+    if(m_lastline.size() == 0u && m_emptyenterrepeat && getHistorySize() != 0u)
+        m_lastline = getHistoryItem(getHistorySize() - 1u);
+
+    //what was printed natively so far goes before the command
+    pollOutputCapture();
 
     echoColored(m_lastline, m_colors[ECC_CODE]);
 
-    //always push and then remove first, other way around wouldn't be safe
-    //just make our history always be x lines and do it that way instead of old
-    //way, no need for 'maxhistory' variable or anything
-    m_history.push_back(m_lastline);
-    m_history.erase(m_history.begin());
+    //others' lines first so ours ends up the newest
+    pollHistoryJournal();
+
+    //ring buffer so this is O(1) and doesn't shift all of history each time
+    if(!m_hignoredups || getHistorySize() == 0u || getHistoryItem(getHistorySize() - 1u) != m_lastline)
+    {
+        addHistoryItem(m_lastline);
+        m_hjournal->append(m_lastline);
+    }
 
     //to 'cancel out' previous history browsing
-    m_hindex = m_history.size();
+    m_hindex = getHistorySize();
 
     //call before running, in case crash, exit etc.
     if(m_callbackfuncs[ECT_NEWHISTORY])
@@ -347,22 +617,60 @@ ELINE_PARSE_RESULT LuaConsoleModel::parseLastLine()
     m_buffcmd += m_lastline;
     m_buffcmd += '\n';
 
+    CommandStats stats;
+    for(int i = 0; i < ECOMMAND_METRIC_COUNT; ++i)
+        stats.Values[i] = 0.0;
+
     if(L)
     {
+        const double memstart = priv::getLuaMemory(L);
+        const std::size_t gcstart = priv::getGcCycles(L);
+
+        //cap what the command can take, lifted before printing results
+        LuaConsoleAllocator * allocator = m_cmdmemlimit?getConsoleAllocator(L):0x0;
+        std::size_t oldlimit = 0u;
+        if(allocator)
+        {
+            oldlimit = allocator->getLimit();
+            const std::size_t limit = allocator->getLiveBytes() + m_cmdmemlimit;
+            allocator->setLimit(oldlimit?std::min(oldlimit, limit):limit);
+        }
+
         const int oldtop = lua_gettop(L);
-        bool evalok;
+        const double compilestart = priv::getWallSeconds();
+        int loadstatus;
         if(m_addreturn)
         {
-            evalok = tryEval(true) || tryEval(false);
+            loadstatus = tryEval(true);
+            if(BLA_LUA_OK != loadstatus)
+                loadstatus = tryEval(false);
         }
         else
         {
-            evalok = tryEval(false);
+            loadstatus = tryEval(false);
         }
-        if(evalok && BLA_LUA_OK == lua_pcall(L, 0, LUA_MULTRET, 0))
+
+        //compiling can hit the memory cap too, that is not a syntax error
+        const bool evalok = (BLA_LUA_OK == loadstatus);
+        const double runstart = priv::getWallSeconds();
+        const double cpustart = priv::getThreadCpuSeconds();
+        const int status = evalok?lua_pcall(L, 0, LUA_MULTRET, 0):loadstatus;
+        if(allocator)
+            allocator->setLimit(oldlimit);
+
+        //before printing results, that takes memory and time too
+        stats.Values[ECM_CPU] = priv::getThreadCpuSeconds() - cpustart;
+        stats.Values[ECM_WALL] = priv::getWallSeconds() - runstart;
+        stats.Values[ECM_COMPILE] = runstart - compilestart;
+        stats.Values[ECM_MEMORY] = priv::getLuaMemory(L) - memstart;
+        stats.Values[ECM_GC_CYCLES] = static_cast<double>(priv::getGcCycles(L) - gcstart);
+
+        if(evalok && BLA_LUA_OK == status)
         {
             m_buffcmd.clear(); //worked & done - clear it
-            if(m_printeval && oldtop != lua_gettop(L))
+            if(m_printeval && oldtop != lua_gettop(L) && m_inspect)
+                inspectLuaStack(oldtop + 1, lua_gettop(L), m_colors[ECC_EVAL]);
+            else if(m_printeval && oldtop != lua_gettop(L))
                 printLuaStackInColor(oldtop + 1, lua_gettop(L), m_colors[ECC_EVAL]);
         }
         else
@@ -374,7 +682,13 @@ ELINE_PARSE_RESULT LuaConsoleModel::parseLastLine()
             {
                 m_buffcmd.clear(); //failed normally - clear it
                 echoColored(err, m_colors[ECC_ERROR]);
-                ret = evalok?ELPR_RUNTIME_ERROR:ELPR_PARSE_ERROR;
+                ret = (evalok || status == LUA_ERRMEM)?ELPR_RUNTIME_ERROR:ELPR_PARSE_ERROR;
+                if(allocator && status == LUA_ERRMEM)
+                {
+                    char msg[80];
+                    std::sprintf(msg, "(command memory limit of %lu bytes reached)", static_cast<unsigned long>(m_cmdmemlimit));
+                    echoColored(msg, m_colors[ECC_WARNING]);
+                }
             }
             lua_pop(L, 1);
         }//got an error, real or <eof>/incomplete chunk one
@@ -386,6 +700,14 @@ ELINE_PARSE_RESULT LuaConsoleModel::parseLastLine()
         ret = ELPR_NO_LUA;
     }//L is null
 
+    //all the command wrote goes to scrollback now, even without a final newline
+    flushOutputLines(true);
+    pollOutputCapture();
+
+    //only complete chunks count as commands
+    if(ret != ELPR_MORE && ret != ELPR_NO_LUA)
+        recordCommandStats(stats);
+
     //if this line was freshcode and cmd commands feature is enabled, check it
     if(freshcode && m_commentcommands)
         checkSpecialComments();
@@ -397,14 +719,99 @@ ELINE_PARSE_RESULT LuaConsoleModel::parseLastLine()
     return ret;
 }
 
+static std::size_t pushWideMessages(const priv::ColoredLine& str, std::deque<priv::ColoredLine>* widemsgs, unsigned width);
+
+//check if line is cmd followed by a space and an id, and get the id
+static bool parseIdCommand(const std::string& line, const char * cmd, unsigned& id)
+{
+    const std::size_t len = std::strlen(cmd);
+    if(line.compare(0u, len, cmd) != 0 || line.size() <= len + 1u || line[len] != ' ')
+        return false;
+
+    //strtoul would take leading spaces and a sign too, so '-1' came out huge
+    if(!std::isdigit(static_cast<unsigned char>(line[len + 1u])))
+        return false;
+
+    char * end;
+    id = std::strtoul(line.c_str() + len + 1u, &end, 10);
+    return *end == '\0';
+}
+
 void LuaConsoleModel::checkSpecialComments()
 {
+    unsigned id;
+    if(parseIdCommand(m_lastline, "--open", id))
+        openInspectedTable(id);
+
+    if(parseIdCommand(m_lastline, "--more", id))
+        moreInspectedTable(id);
+
+    if(parseIdCommand(m_lastline, "--close", id))
+        closeInspectedTable(id);
+
+    if(m_lastline == "--profile start" || parseIdCommand(m_lastline, "--profile start", id))
+    {
+        //interval is in milliseconds here, 10 if not given
+        const double interval = (m_lastline.size() > 15u)?id * 1e-3:1e-2;
+        if(startProfiler(interval))
+            echoColored("Profiler started, --profile stop and --profile report to see results", m_colors[ECC_HINT]);
+        else
+            echoColored("Can't start profiler, there's no state, it already has a hook or SIGPROF is taken", m_colors[ECC_ERROR]);
+    }
+
+    if(m_lastline.compare(0u, 7u, "--time ") == 0)
+    {
+        //count is optional and goes first, rest of line is the code
+        const char * code = m_lastline.c_str() + 7u;
+        char * end = 0x0;
+        std::size_t calls = 0u;
+        if(*code >= '0' && *code <= '9')
+            calls = std::strtoul(code, &end, 10);
+
+        if(end && *end == ' ')
+            code = end + 1;
+        else if(end && *end == '\0')
+            code = end; //count and no code, '--time 100' is not timing 100
+        else
+            calls = 0u;
+
+        if(code[std::strspn(code, " \t")] == '\0')
+            echoColored("Nothing to time, usage is --time [calls] code", m_colors[ECC_HINT]);
+        else
+            timeCode(code, calls);
+    }
+
+    if(m_lastline == "--gc")
+        echoGcStats();
+
+    if(m_lastline == "--profile stop")
+        stopProfiler();
+
+    if(m_lastline == "--profile report" || parseIdCommand(m_lastline, "--profile report", id))
+        reportProfile((m_lastline.size() > 16u)?id:10u);
+
     if(m_lastline == "--clear")
         clearScreen();
 
     if(m_lastline == "--history")
-        for(std::size_t i = 0u; i < m_history.size(); ++i)
-            echoColored(m_history[i], m_colors[ECC_HISTORY]);
+        for(std::size_t i = 0u; i < getHistorySize(); ++i)
+            echoColored(getHistoryItem(i), m_colors[ECC_HISTORY]);
+
+    if(m_lastline == "--grep" || m_lastline.compare(0u, 7u, "--grep ") == 0)
+    {
+        //don't search the echo of this very command or our own message below
+        wrapMessages();
+        const std::size_t own = m_msg.empty()?0u:pushWideMessages(m_msg.back(), 0x0, m_w);
+        const std::string text = m_lastline.size() > 7u?m_lastline.substr(7u):"";
+        const std::size_t count = grepWideLines(text, m_widemsg.size() - own);
+        if(!m_grep.empty())
+        {
+            std::ostringstream ss;
+            ss << count << " matches, F3 and Shift + F3 to jump between them";
+            echoColored(ss.str(), m_colors[ECC_HINT]);
+            showCurrentMatch();
+        }
+    }
 }
 
 void LuaConsoleModel::addChar(char c)
@@ -412,6 +819,18 @@ void LuaConsoleModel::addChar(char c)
     if(c < ' ' || c >= 127)
         return;
 
+    if(m_searching)
+    {
+        //keep current match if it still matches, like bash does
+        m_searchquery += c;
+        const bool hasmatch = !m_searchfailed && m_searchmatch != m_hnext;
+        runHistorySearch(hasmatch?m_searchmatch + 1u:m_hnext, false);
+        return;
+    }
+
+    if(m_hindexdirty)
+        reindexHistory();
+
     m_lastline.insert(m_lastline.begin() + m_cur - 1, c);
     ++m_cur;
     ensureCurInView();
@@ -420,6 +839,16 @@ void LuaConsoleModel::addChar(char c)
 
 void LuaConsoleModel::backspace()
 {
+    if(m_searching)
+    {
+        if(!m_searchquery.empty())
+        {
+            m_searchquery.erase(m_searchquery.size() - 1u);
+            runHistorySearch(m_hnext, false);
+        }
+        return;
+    }
+
     if(m_cur > 1)
     {
         --m_cur;
@@ -431,6 +860,9 @@ void LuaConsoleModel::backspace()
 
 void LuaConsoleModel::del()
 {
+    if(m_searching)
+        stopHistorySearch(true);
+
     m_lastline.erase(m_cur - 1, 1);
     ++m_dirtyness;
 }
@@ -440,29 +872,46 @@ unsigned LuaConsoleModel::getDirtyness() const
     return m_dirtyness;
 }
 
+//push count chars of str from start as a wide line, pieces of a pinned str
+//point into the same lua string
+static void pushWidePiece(const priv::ColoredLine& str, std::size_t start, std::size_t count,
+                          std::deque<priv::ColoredLine>* widemsgs)
+{
+    widemsgs->push_back(priv::ColoredLine());
+    priv::ColoredLine& piece = widemsgs->back();
+    if(str.Pinned)
+    {
+        piece.Pinned = str.Pinned + start;
+        piece.PinnedSize = count;
+        piece.Color.assign(1u, str.Color[0]);
+    }
+    else
+    {
+        piece.Text.assign(str.Text, start, count);
+        piece.Color.assign(str.Color, start, count);
+    }
+}
+
 //split str on newlines and to fit 'width' length and push to given vector (if not null)
 //returns how many messages str was split into
 
-static std::size_t pushWideMessages(const priv::ColoredLine& str, std::vector<priv::ColoredLine>* widemsgs, unsigned width)
+static std::size_t pushWideMessages(const priv::ColoredLine& str, std::deque<priv::ColoredLine>* widemsgs, unsigned width)
 {
     std::size_t ret = 0u;
     std::size_t charcount = 0u;
     std::size_t start = 0u;
 
     //push pieces of str if they go over width or if we encounter a newline
-    for(std::size_t i = 0u; i < str.Text.size(); ++i)
+    const char * text = str.getText();
+    for(std::size_t i = 0u; i < str.getSize(); ++i)
     {
         ++charcount;
-        if(str.Text[i] == '\n' || charcount >= width)
+        if(text[i] == '\n' || charcount >= width)
         {
-            if(str.Text[i] == '\n') --charcount;
+            if(text[i] == '\n') --charcount;
             if(widemsgs)
-            {
-                priv::ColoredLine line;
-                line.Text = str.Text.substr(start, charcount);
-                line.Color = str.Color.substr(start, charcount);
-                widemsgs->push_back(line);
-            }
+                pushWidePiece(str, start, charcount, widemsgs);
+
             ++ret;
             start = i + 1u;
             charcount = 0u;
@@ -473,418 +922,2221 @@ static std::size_t pushWideMessages(const priv::ColoredLine& str, std::vector<pr
     if(charcount != 0u)
     {
         if(widemsgs)
-        {
-            priv::ColoredLine line;
-            line.Text = str.Text.substr(start, charcount);
-            line.Color = str.Color.substr(start, charcount);
-            widemsgs->push_back(line);
-        }
+            pushWidePiece(str, start, charcount, widemsgs);
+
         ++ret;
     }
+
+    //repeat counter is drawn after the last piece
+    if(widemsgs && ret != 0u)
+        widemsgs->back().Repeats = str.Repeats;
+
+    return ret;
+}
+
+//write repeat counter of line into buff, returns its' length
+static std::size_t formatRepeatSuffix(const priv::ColoredLine& line, char * buff)
+{
+    return std::sprintf(buff, " (x%lu)", static_cast<unsigned long>(line.Repeats + 1u));
+}
+
+//where repeat counter of a line with size chars starts, at its' end or over
+//the end of text if there is no room for it in console width
+static std::size_t getRepeatSuffixStart(std::size_t size, std::size_t suffixsize)
+{
+    return std::min<std::size_t>(size, kInnerWidth - suffixsize);
+}
+
+//copy of line with its' repeat counter put at its' end
+static priv::ColoredLine withRepeatSuffix(const priv::ColoredLine& line)
+{
+    char suffix[32];
+    const std::size_t suffixsize = formatRepeatSuffix(line, suffix);
+    const unsigned color = line.Color.empty()?0xffffffff:line.Color[line.Color.size() - 1u];
+
+    priv::ColoredLine ret = line;
+    ret.unpin();
+    ret.Repeats = 0u;
+    const std::size_t start = getRepeatSuffixStart(ret.Text.size(), suffixsize);
+    ret.Text.replace(start, std::string::npos, suffix, suffixsize);
+    ret.Color.resize(start);
+    ret.Color.append(suffixsize, color);
     return ret;
 }
 
+//push line to cold scrollback with its' repeat counter baked in, if/else and
+//not ?: since that would copy line even when it has no repeats
+static void pushCold(priv::ColdScrollback * cold, const priv::ColoredLine& line)
+{
+    if(line.Repeats)
+        cold->push(withRepeatSuffix(line));
+    else
+        cold->push(line);
+}
+
 void LuaConsoleModel::echo(const std::string& str)
 {
-    echoColored(str, m_colors[ECC_ECHO]);
+    echoMessage(str.data(), str.size(), 0x0, m_colors[ECC_ECHO], 0x0);
 }
 
-void LuaConsoleModel::echoColored(const std::string& str, unsigned textcolor)
+void LuaConsoleModel::echo(const char * str, std::size_t len)
 {
-    const ColorString color(str.size(), textcolor);
-    echoLine(str, color);
+    echoMessage(str, len, 0x0, m_colors[ECC_ECHO], 0x0);
 }
 
-void LuaConsoleModel::echoLine(const std::string& str, const ColorString& colors)
+void LuaConsoleModel::echo(const char * str)
 {
-    if(str.empty()) return echoLine(" ", colors); //workaround for a bug??
+    echoMessage(str, std::strlen(str), 0x0, m_colors[ECC_ECHO], 0x0);
+}
 
-    priv::ColoredLine line;
-    line.Text = str;
-    line.Color = colors;
-    line.resizeColorToFitText(m_colors[ECC_ECHO]);
+#ifdef BLA_HAS_RVALUE_REFERENCES
 
-    m_msg.push_back(line);
+void LuaConsoleModel::echo(std::string&& str)
+{
+    echoMessage(str.data(), str.size(), 0x0, m_colors[ECC_ECHO], &str);
+}
 
-    pushWideMessages(line, &m_widemsg, m_w);
+#endif
 
-    if(m_msg.size() > kMessagesKeptCount)
-    {
-        const std::size_t msgs = pushWideMessages(*m_msg.begin(), 0x0, m_w);
-        m_msg.erase(m_msg.begin());
-        m_widemsg.erase(m_widemsg.begin(), m_widemsg.begin() + msgs);
-    }
+#ifdef BLA_HAS_STRING_VIEW
 
-    scrollLines(kScrollLinesEnd); //make this conditional?
-    ++m_dirtyness;
+void LuaConsoleModel::echo(std::string_view str)
+{
+    echoMessage(str.data(), str.size(), 0x0, m_colors[ECC_ECHO], 0x0);
 }
 
-const std::string& LuaConsoleModel::getWideMsg(int index) const
+#endif
+
+void LuaConsoleModel::echof(const char * fmt, ...)
 {
-    if(index < 0) index = m_widemsg.size() + index;
-    index += m_firstmsg;
-    if(index < 0 || static_cast<std::size_t>(index) >= m_widemsg.size()) return m_empty.Text;
+    va_list args;
+    va_start(args, fmt);
+    int len = formatToBuffer(fmt, args);
+    va_end(args);
+    if(len < 0)
+        return;
 
-    return m_widemsg[index].Text;
+    //buffer got grown to fit the line, so format it again
+    if(static_cast<std::size_t>(len) >= m_formatbuff.size())
+    {
+        m_formatbuff.resize(len + 1);
+        va_start(args, fmt);
+        len = formatToBuffer(fmt, args);
+        va_end(args);
+    }
+    echoMessage(&m_formatbuff[0], len, 0x0, m_colors[ECC_ECHO], 0x0);
 }
 
-const ColorString& LuaConsoleModel::getWideColor(int index) const
+void LuaConsoleModel::echoColored(const std::string& str, unsigned textcolor)
 {
-    if(index < 0) index = m_widemsg.size() + index;
-    index += m_firstmsg;
-    if(index < 0 || static_cast<std::size_t>(index) >= m_widemsg.size()) return m_empty.Color;
-
-    return m_widemsg[index].Color;
+    echoMessage(str.data(), str.size(), 0x0, textcolor, 0x0);
 }
 
-int LuaConsoleModel::getCurPos() const
+void LuaConsoleModel::echoColored(const char * str, std::size_t len, unsigned textcolor)
 {
-    return m_cur - m_lastlineoffset;
+    echoMessage(str, len, 0x0, textcolor, 0x0);
 }
 
-static int ConsoleModel_echo(lua_State * L)
+void LuaConsoleModel::echoColored(const char * str, unsigned textcolor)
 {
-    LuaConsoleModel * m = *static_cast<LuaConsoleModel**>(lua_touserdata(L, lua_upvalueindex(1)));
-    if(m)
-        m->echo(luaL_checkstring(L, 1));
+    echoMessage(str, std::strlen(str), 0x0, textcolor, 0x0);
+}
 
-    return 0;
+#ifdef BLA_HAS_RVALUE_REFERENCES
+
+void LuaConsoleModel::echoColored(std::string&& str, unsigned textcolor)
+{
+    echoMessage(str.data(), str.size(), 0x0, textcolor, &str);
 }
 
-static int ConsoleModel_gc(lua_State * L)
+#endif
+
+#ifdef BLA_HAS_STRING_VIEW
+
+void LuaConsoleModel::echoColored(std::string_view str, unsigned textcolor)
 {
-    LuaConsoleModel * m = *static_cast<LuaConsoleModel**>(lua_touserdata(L, 1));
+    echoMessage(str.data(), str.size(), 0x0, textcolor, 0x0);
+}
 
-    //rationale: assume if our instance in registry and all references of it 
-    //got destroyed we are not able to or supposed to use the same L anymore
-    if(m)
-        m->setL(0x0);
+#endif
 
-    return 0;
+void LuaConsoleModel::echoLine(const std::string& str, const ColorString& colors)
+{
+    echoMessage(str.data(), str.size(), &colors, m_colors[ECC_ECHO], 0x0);
 }
 
-void LuaConsoleModel::setL(lua_State * L)
+//check if line has exactly the colors that colors (resized to len, with fill
+//past its' end) or just fill (if colors is null) would give it
+static bool hasColors(const priv::ColoredLine& line, std::size_t len, const ColorString * colors, unsigned fill)
 {
-    //TODO: add support for more L's being linked/using echos at once??
-    this->L = L;
+    for(std::size_t i = 0u; i < len; ++i)
+        if(line.getColor(i) != ((colors && i < colors->size())?(*colors)[i]:fill))
+            return false;
 
-    //clear and disarm, so the state that used us before is no longer able to
-    m_luaptr.clearLuaPointer();
-    m_luaptr.disarmLuaPointer();
+    return true;
+}
 
-    if(L)
+//all echoes end here, the line is built right in m_msg so the only copies
+//are the ones kept in scrollback, colors null means all chars are in fill,
+//if take is not null its' buffer is swapped into the line instead of copying
+void LuaConsoleModel::echoMessage(const char * str, std::size_t len, const ColorString * colors,
+                                  unsigned fill, std::string * take)
+{
+    //whatever was written before this line goes before it
+    if(!m_outbuff.empty())
+        flushOutputLines(true);
+
+    if(len == 0u) //workaround for a bug??
     {
-        LuaConsoleModel ** ptr = static_cast<LuaConsoleModel**>(lua_newuserdata(L, sizeof (LuaConsoleModel*)));
-        (*ptr) = this;
-        m_luaptr.setLuaPointer(ptr);
+        str = " ";
+        len = 1u;
+        take = 0x0;
+    }
 
-        //make and set new metatable with gc in it
+    if(repeatLastMessage(str, len, colors, fill))
+        return endEcho();
 
-        luaL_newmetatable(L, kMetaname); //table
-        lua_pushliteral(L, "__gc");
-        lua_pushcfunction(L, &ConsoleModel_gc);
-        lua_settable(L, -3); //table[gc]=ConsoleModel_gc
-        lua_setmetatable(L, -2);
+    m_msg.push_back(priv::ColoredLine());
+    priv::ColoredLine& line = m_msg.back();
+    if(take)
+        line.Text.swap(*take);
+    else
+        line.Text.assign(str, len);
+
+    if(colors)
+    {
+        line.Color.assign(*colors, 0u, len);
+        line.resizeColorToFitText(fill);
+    }
+    else
+    {
+        line.Color.assign(len, fill);
+    }
+
+    addMessage();
+    endEcho();
+}
+
+void LuaConsoleModel::echoLuaString(lua_State * L, int index, unsigned textcolor)
+{
+    std::size_t len;
+    const char * str = luaL_checklstring(L, index, &len);
+    if(this->L)
+        releaseDroppedPins(L);
+
+    //short ones are cheaper to copy than to keep a registry ref to
+    if(len < kPinnedMinSize || !this->L)
+        return echoMessage(str, len, 0x0, textcolor, 0x0);
+
+    if(!m_outbuff.empty())
+        flushOutputLines(true);
+
+    if(repeatLastMessage(str, len, 0x0, textcolor))
+        return endEcho();
+
+    //lua never moves strings so the bytes stay put for as long as ref keeps it alive
+    lua_pushvalue(L, index);
+    m_pinnedrefs.push_back(luaL_ref(L, LUA_REGISTRYINDEX));
+
+    m_msg.push_back(priv::ColoredLine());
+    m_msg.back().Pinned = str;
+    m_msg.back().PinnedSize = len;
+    m_msg.back().Color.assign(1u, textcolor);
+    addMessage();
+    endEcho();
+}
+
+//if repeats are collapsed and the line is the same as the last message then
+//count it as repeated and return true, else return false and do nothing
+bool LuaConsoleModel::repeatLastMessage(const char * str, std::size_t len, const ColorString * colors, unsigned fill)
+{
+    //length check first rejects almost all lines that differ without looking at
+    //them, if last message isn't wrapped yet it takes the count along when it is
+    if(!m_collapserepeats || m_msg.empty() || m_msg.back().getSize() != len ||
+       std::memcmp(m_msg.back().getText(), str, len) != 0 || !hasColors(m_msg.back(), len, colors, fill))
+        return false;
+
+    ++m_msg.back().Repeats;
+    if(m_unwrapped == 0u)
+        ++m_widemsg.back().Repeats;
+
+    return true;
+}
+
+//take in the message just put at the end of m_msg
+void LuaConsoleModel::addMessage()
+{
+    ++m_unwrapped;
+    if(m_batchdepth == 0u)
+        wrapMessages();
+
+    if(m_msg.size() > kMessagesKeptCount)
+        dropOldestMessage();
+}
+
+void LuaConsoleModel::endEcho()
+{
+    if(m_batchdepth != 0u)
+    {
+        m_batchechoed = true;
+        return;
+    }
+
+    scrollLines(kScrollLinesEnd); //make this conditional?
+    ++m_dirtyness;
+}
+
+//release all pinned lua strings, copying them into their lines first if copy
+//is true, L must still be the state they were pinned in
+void LuaConsoleModel::unpinMessages(bool copy)
+{
+    if(copy && !m_pinnedrefs.empty())
+    {
+        for(std::size_t i = 0u; i < m_msg.size(); ++i)
+            m_msg[i].unpin();
+
+        for(std::size_t i = 0u; i < m_widemsg.size(); ++i)
+            m_widemsg[i].unpin();
+    }
+
+    for(std::size_t i = 0u; i < m_pinnedrefs.size(); ++i)
+        luaL_unref(L, LUA_REGISTRYINDEX, m_pinnedrefs[i]);
+
+    m_pinnedrefs.clear();
+    releaseDroppedPins(L);
+}
+
+//release refs of pinned strings whose messages were dropped, L is the
+//attached state or the thread of it that's calling us
+void LuaConsoleModel::releaseDroppedPins(lua_State * L)
+{
+    for(std::size_t i = 0u; i < m_droppedpins.size(); ++i)
+        luaL_unref(L, LUA_REGISTRYINDEX, m_droppedpins[i]);
+
+    m_droppedpins.clear();
+}
+
+//vsnprintf into m_formatbuff, returns the length of whole formatted line, if
+//that doesn't fit then the caller has to grow the buffer and call this again
+int LuaConsoleModel::formatToBuffer(const char * fmt, va_list args)
+{
+    return std::vsnprintf(&m_formatbuff[0], m_formatbuff.size(), fmt, args);
+}
+
+void LuaConsoleModel::echoSpans(const char * str, std::size_t len, const ColorSpan * spans, std::size_t count)
+{
+    priv::applyColorSpans(spans, count, len, m_colors[ECC_ECHO], m_spancolors);
+    echoMessage(str, len, &m_spancolors, m_colors[ECC_ECHO], 0x0);
+}
+
+void LuaConsoleModel::echoMarkup(const char * str, std::size_t len)
+{
+    priv::parseColorMarkup(str, len, m_colors[ECC_ECHO], m_markuptext, m_spancolors);
+    echoMessage(m_markuptext.data(), m_markuptext.size(), &m_spancolors, m_colors[ECC_ECHO], 0x0);
+}
+
+void LuaConsoleModel::setChannelSeverity(unsigned channel, ECONSOLE_SEVERITY severity)
+{
+    if(channel < kChannelCount)
+        m_channelseverity[channel] = severity;
+}
+
+ECONSOLE_SEVERITY LuaConsoleModel::getChannelSeverity(unsigned channel) const
+{
+    if(channel < kChannelCount)
+        return static_cast<ECONSOLE_SEVERITY>(m_channelseverity[channel]);
+
+    return ECS_OFF;
+}
+
+bool LuaConsoleModel::isChannelEnabled(unsigned channel, ECONSOLE_SEVERITY severity) const
+{
+    return channel < kChannelCount && severity < ECS_OFF && severity >= m_channelseverity[channel];
+}
+
+void LuaConsoleModel::echoChannel(unsigned channel, ECONSOLE_SEVERITY severity, const std::string& str)
+{
+    if(!isChannelEnabled(channel, severity))
+        return;
+
+    echoColored(str, m_colors[kSeverityColors[severity]]);
+}
+
+void LuaConsoleModel::echoChannelFormat(unsigned channel, ECONSOLE_SEVERITY severity, const char * fmt, ...)
+{
+    if(!isChannelEnabled(channel, severity))
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    int len = formatToBuffer(fmt, args);
+    va_end(args);
+    if(len < 0)
+        return;
+
+    if(static_cast<std::size_t>(len) >= m_formatbuff.size())
+    {
+        m_formatbuff.resize(len + 1);
+        va_start(args, fmt);
+        len = formatToBuffer(fmt, args);
+        va_end(args);
+    }
+
+    echoMessage(&m_formatbuff[0], len, 0x0, m_colors[kSeverityColors[severity]], 0x0);
+}
+
+void LuaConsoleModel::beginBatch()
+{
+    ++m_batchdepth;
+}
+
+void LuaConsoleModel::endBatch()
+{
+    if(m_batchdepth == 0u || --m_batchdepth != 0u)
+        return;
+
+    wrapMessages();
+    m_sbfile->flush();
+    if(m_batchechoed)
+    {
+        m_batchechoed = false;
+        scrollLines(kScrollLinesEnd);
+        ++m_dirtyness;
+    }
+}
+
+void LuaConsoleModel::wrapMessages()
+{
+    for(std::size_t i = m_msg.size() - m_unwrapped; i < m_msg.size(); ++i)
+    {
+        const std::size_t added = pushWideMessages(m_msg[i], &m_widemsg, m_w);
+        for(std::size_t j = m_widemsg.size() - added; m_sbfile->isOpen() && j < m_widemsg.size(); ++j)
+            m_sbfile->append(m_widemsg[j]);
+    }
+
+    m_unwrapped = 0u;
+    m_sbfile->flush(false);
+}
+
+void LuaConsoleModel::writeOutput(const char * str, std::size_t len)
+{
+    m_outbuff.append(str, len);
+    if(m_outbuff.size() < kOutputFlushSize)
+        return;
+
+    flushOutputLines(false);
+    if(m_outbuff.size() >= kOutputFlushSize)
+        flushOutputLines(true);
+}
+
+void LuaConsoleModel::flushOutput()
+{
+    flushOutputLines(false);
+    pollOutputCapture();
+}
+
+bool LuaConsoleModel::openOutputCapture(bool capturestdout, bool capturestderr, bool tee)
+{
+    return m_capture->open(capturestdout, capturestderr, tee);
+}
+
+void LuaConsoleModel::closeOutputCapture()
+{
+    m_capture->close();
+    pollOutputCapture();
+}
+
+bool LuaConsoleModel::isOutputCaptureOpen() const
+{
+    return m_capture->isOpen();
+}
+
+//echo lines captured from stdout and stderr since last time in one batch
+void LuaConsoleModel::pollOutputCapture()
+{
+    std::size_t dropped;
+    const priv::CapturedLines& captured = m_capture->take(dropped);
+    if(captured.Lines.empty() && dropped == 0u)
+        return;
+
+    beginBatch();
+    for(std::size_t i = 0u; i < captured.Lines.size(); ++i)
+    {
+        const priv::CapturedLine& line = captured.Lines[i];
+        const unsigned color = m_colors[line.Error?ECC_ERROR:ECC_ECHO];
+        echoMessage(captured.Text.data() + line.Start, line.Length, 0x0, color, 0x0);
+    }
+
+    if(dropped != 0u)
+    {
+        char msg[80];
+        std::sprintf(msg, "(%lu lines of captured output dropped)", static_cast<unsigned long>(dropped));
+        echoColored(msg, m_colors[ECC_WARNING]);
+    }
+    endBatch();
+}
+
+//echo lines of the output buffer, all of it if all is true, else only up to
+//and including the last newline, each newline ends a line and \r\n does too
+void LuaConsoleModel::flushOutputLines(bool all)
+{
+    const std::size_t end = all?m_outbuff.size():m_outbuff.rfind('\n') + 1u; //npos + 1 is 0
+    if(end == 0u)
+        return;
+
+    //take it all out first, so the echoes below don't find output to flush
+    m_outflush.swap(m_outbuff);
+
+    beginBatch();
+    std::size_t start = 0u;
+    while(start < end)
+    {
+        std::size_t stop = m_outflush.find('\n', start);
+        if(stop == std::string::npos || stop > end)
+            stop = end;
+
+        std::size_t len = stop - start;
+        if(len != 0u && m_outflush[stop - 1u] == '\r')
+            --len;
+
+        echoMessage(m_outflush.data() + start, len, 0x0, m_colors[ECC_ECHO], 0x0);
+        start = stop + 1u;
+    }
+    endBatch();
+
+    //partial line stays, both buffers keep their capacity
+    m_outbuff.assign(m_outflush, end, std::string::npos);
+    m_outflush.clear();
+}
+
+void LuaConsoleModel::dropOldestMessage()
+{
+    const priv::ColoredLine& msg = m_msg.front();
+    if(m_unwrapped == m_msg.size())
+    {
+        //nobody will ever see it on screen, so only wrap it if it's kept
+        //in cold scrollback or file, otherwise it never gets wide line numbers
+        --m_unwrapped;
+        if(m_cold->getMaxLines() != 0u || m_sbfile->isOpen())
+        {
+            std::deque<priv::ColoredLine> wide;
+            pushWideMessages(msg, &wide, m_w);
+            for(std::size_t i = 0u; i < wide.size(); ++i)
+            {
+                m_sbfile->append(wide[i]);
+                pushCold(m_cold, wide[i]);
+            }
+            m_widedropped += wide.size();
+        }
+    }
+    else
+    {
+        const std::size_t msgs = pushWideMessages(msg, 0x0, m_w);
+        for(std::size_t i = 0u; i < msgs; ++i)
+            pushCold(m_cold, m_widemsg[i]);
+
+        m_widemsg.erase(m_widemsg.begin(), m_widemsg.begin() + msgs);
+        m_widedropped += msgs;
+    }
+
+    //its' wide lines are all gone too (or copied to cold), so let lua have it
+    //back, but not right now, this might be blua_echo that must not touch lua
+    if(msg.Pinned)
+    {
+        m_droppedpins.push_back(m_pinnedrefs.front());
+        m_pinnedrefs.pop_front();
+    }
+    m_msg.pop_front();
+}
+
+//archived lines go before all others, then sort by line
+static bool matchLineLess(const priv::ScrollbackMatch& a, const priv::ScrollbackMatch& b)
+{
+    if(a.Archived != b.Archived)
+        return a.Archived;
+
+    return a.Line < b.Line;
+}
+
+//add matches of text in line to matches, they don't overlap, so 'aa' is
+//found twice in 'aaaa', not thrice
+static void grepLine(const priv::ColoredLine& line, const std::string& text, bool archived,
+                     std::size_t lineno, std::vector<priv::ScrollbackMatch>& matches)
+{
+    const char * l = line.getText();
+    const std::size_t size = line.getSize();
+    priv::ScrollbackMatch match;
+    match.Archived = archived;
+    match.Line = lineno;
+    std::size_t start = 0u;
+    while(true)
+    {
+        const std::size_t found = priv::findSubstring(l + start, size - start, text.data(), text.size());
+        if(found == priv::kNoMatch)
+            break;
+
+        match.Start = start + found;
+        matches.push_back(match);
+        start += found + text.size();
+    }
+}
+
+//index counts from first line of scrollback file archive, then go cold lines
+//and then m_widemsg ones
+const priv::ColoredLine& LuaConsoleModel::getWideLine(int index) const
+{
+    const std::size_t archived = getArchivedLineCount();
+    const std::size_t cold = getColdLineCount();
+    if(index < 0) index = getWideLineCount() + index;
+    index += m_firstmsg;
+    if(index < 0 || static_cast<std::size_t>(index) >= getWideLineCount()) return m_empty;
+
+    if(static_cast<std::size_t>(index) < archived)
+        return m_sbfile->getArchivedLine(index);
+
+    index -= archived;
+    if(static_cast<std::size_t>(index) < cold)
+        return m_cold->getLine(m_cold->getBegin() + index);
+
+    return m_widemsg[index - cold];
+}
+
+std::size_t LuaConsoleModel::getWideLineCount() const
+{
+    return getArchivedLineCount() + getColdLineCount() + m_widemsg.size();
+}
+
+std::size_t LuaConsoleModel::getArchivedLineCount() const
+{
+    return m_sbfile->getArchivedCount();
+}
+
+std::size_t LuaConsoleModel::getColdLineCount() const
+{
+    return m_cold->getEnd() - m_cold->getBegin();
+}
+
+int LuaConsoleModel::getCurPos() const
+{
+    //cursor sits right after the searched text, clipped to the prompt line
+    if(m_searching)
+    {
+        const char * prompt = m_searchfailed?kFailedSearchPrompt:kSearchPrompt;
+        return std::min<int>(std::strlen(prompt) + m_searchquery.size() + 1, kInnerWidth);
+    }
+
+    return m_cur - m_lastlineoffset;
+}
+
+static int ConsoleModel_echo(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    luaL_checkstring(L, 1);
+    if(m)
+        m->echoLuaString(L, 1, m->getColor(ECC_ECHO));
+
+    return 0;
+}
+
+//colors are 0xrrggbbaa and don't fit in lua_Integer of 32 bit 5.1 builds
+static unsigned checkColor(lua_State * L, int index)
+{
+    //written so NaN fails it too, casting NaN is undefined
+    const lua_Number n = luaL_checknumber(L, index);
+    if(!(n > 0))
+        return 0u;
+
+    if(n >= 4294967295.0)
+        return 0xffffffffu;
+
+    return static_cast<unsigned>(n);
+}
+
+static int ConsoleModel_echolines(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    luaL_checktype(L, 1, LUA_TTABLE);
+    const bool hascolor = !lua_isnoneornil(L, 2);
+    const unsigned color = hascolor?checkColor(L, 2):0u;
+    lua_settop(L, 1);
+
+    //check all lines first, so either all or none of them get echoed
+    int count = 0;
+    for(;; ++count)
+    {
+        lua_rawgeti(L, 1, count + 1);
+        const int type = lua_type(L, -1);
+        lua_pop(L, 1);
+        if(type == LUA_TNIL)
+            break;
+
+        if(type != LUA_TSTRING && type != LUA_TNUMBER)
+            return luaL_error(L, "echolines entry %d is not a string", count + 1);
+    }
+
+    if(!m)
+        return 0;
+
+    //one batch, so all lines are wrapped and scrolled to at once
+    m->beginBatch();
+    for(int i = 1; i <= count; ++i)
+    {
+        lua_rawgeti(L, 1, i);
+        std::size_t len;
+        const char * str = lua_tolstring(L, -1, &len);
+        m->echoColored(str, len, hascolor?color:m->getColor(ECC_ECHO));
+        lua_pop(L, 1);
+    }
+    m->endBatch();
+    return 0;
+}
+
+static int ConsoleModel_echospans(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    std::size_t len;
+    const char * str = luaL_checklstring(L, 1, &len);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    //count and check spans first, so only very long span lists need a heap
+    //buffer and nothing below can raise an error and longjmp past that buffer
+    int count = 0;
+    for(;; ++count)
+    {
+        lua_rawgeti(L, 2, 3 * count + 1);
+        lua_rawgeti(L, 2, 3 * count + 2);
+        lua_rawgeti(L, 2, 3 * count + 3);
+        const bool end = lua_isnil(L, -3);
+        const bool ok = lua_isnumber(L, -3) && lua_isnumber(L, -2) && lua_isnumber(L, -1);
+        lua_pop(L, 3);
+        if(end)
+            break;
+
+        if(!ok)
+            return luaL_error(L, "echospans span %d is not start, length, color", count + 1);
+    }
+
+    ColorSpan stackspans[64];
+    std::vector<ColorSpan> heapspans;
+    if(count > 64)
+        heapspans.resize(count);
+
+    ColorSpan * spans = (count > 64)?&heapspans[0]:stackspans;
+    std::size_t used = 0u;
+    for(int i = 0; i < count; ++i)
+    {
+        lua_rawgeti(L, 2, 3 * i + 1);
+        lua_rawgeti(L, 2, 3 * i + 2);
+        lua_rawgeti(L, 2, 3 * i + 3);
+        const lua_Number start = lua_tonumber(L, -3);
+        const lua_Number length = lua_tonumber(L, -2);
+        const unsigned color = checkColor(L, -1);
+        lua_pop(L, 3);
+
+        //spans outside of str are dropped here, so casts below never overflow,
+        //checks are written so NaN fails them too
+        if(!(start >= 1) || !(start - 1 < len) || !(length > 0))
+            continue;
+
+        spans[used].Start = static_cast<std::size_t>(start - 1);
+        spans[used].Length = (length >= len)?len:static_cast<std::size_t>(length);
+        spans[used].Color = color;
+        ++used;
+    }
+
+    if(m)
+        m->echoSpans(str, len, spans, used);
+
+    return 0;
+}
+
+static int ConsoleModel_echomarkup(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    std::size_t len;
+    const char * str = luaL_checklstring(L, 1, &len);
+    if(m)
+        m->echoMarkup(str, len);
+
+    return 0;
+}
+
+static int ConsoleModel_echocolored(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    std::size_t len;
+    const char * str = luaL_checklstring(L, 1, &len);
+    const unsigned color = checkColor(L, 2);
+    if(m)
+        m->echoColored(str, len, color);
+
+    return 0;
+}
+
+//names of ECONSOLE_COLOR values, for setcolor and getcolor
+const char * const kColorNames[] = {
+    "error", "hint", "code", "echo", "prompt", "title", "frame", "background",
+    "cursor", "eval", "history", "suggestion", "match", "warning", "stats", 0x0
+};
+
+//colors go past int32 so push them as integers only where those are wide enough
+static void pushColor(lua_State * L, unsigned color)
+{
+    if(sizeof(lua_Integer) > sizeof(unsigned))
+        lua_pushinteger(L, static_cast<lua_Integer>(color));
+    else
+        lua_pushnumber(L, color);
+}
+
+static int ConsoleModel_setcolor(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    const int which = luaL_checkoption(L, 1, 0x0, kColorNames);
+    const unsigned color = checkColor(L, 2);
+    if(m)
+        m->setColor(static_cast<ECONSOLE_COLOR>(which), color);
+
+    return 0;
+}
+
+static int ConsoleModel_getcolor(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::checkFromUpvalue(L);
+    const int which = luaL_checkoption(L, 1, 0x0, kColorNames);
+    pushColor(L, m->getColor(static_cast<ECONSOLE_COLOR>(which)));
+    return 1;
+}
+
+static int ConsoleModel_settitle(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    std::size_t len;
+    const char * title = luaL_checklstring(L, 1, &len);
+    if(m)
+        m->setTitle(std::string(title, len));
+
+    return 0;
+}
+
+static int ConsoleModel_gettitle(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::checkFromUpvalue(L);
+    lua_pushlstring(L, m->getTitle().data(), m->getTitle().size());
+    return 1;
+}
+
+static int ConsoleModel_scroll(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    int amount;
+    if(lua_type(L, 1) == LUA_TSTRING)
+    {
+        const char * const where[] = {"top", "bottom", 0x0};
+        amount = (luaL_checkoption(L, 1, 0x0, where) == 0)?kScrollLinesBegin:kScrollLinesEnd;
+    }
+    else
+    {
+        amount = static_cast<int>(luaL_checkinteger(L, 1));
+    }
+
+    if(m)
+        m->scrollLines(amount);
+
+    return 0;
+}
+
+static int ConsoleModel_clear(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    if(m)
+        m->clearScreen();
+
+    return 0;
+}
+
+static int ConsoleModel_setvisible(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    if(m)
+        m->setVisible(lua_toboolean(L, 1));
+
+    return 0;
+}
+
+static int ConsoleModel_isvisible(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::checkFromUpvalue(L);
+    lua_pushboolean(L, m->isVisible());
+    return 1;
+}
+
+static int ConsoleModel_addhistory(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    std::size_t len;
+    const char * item = luaL_checklstring(L, 1, &len);
+    if(m)
+        m->addHistoryItem(std::string(item, len));
+
+    return 0;
+}
+
+static int ConsoleModel_gethistory(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::checkFromUpvalue(L);
+    const lua_Integer index = luaL_checkinteger(L, 1);
+    if(index < 1 || static_cast<std::size_t>(index) > m->getHistorySize())
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    const std::string& item = m->getHistoryItem(index - 1);
+    lua_pushlstring(L, item.data(), item.size());
+    return 1;
+}
+
+static int ConsoleModel_historysize(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::checkFromUpvalue(L);
+    lua_pushinteger(L, static_cast<lua_Integer>(m->getHistorySize()));
+    return 1;
+}
+
+static ECONSOLE_SEVERITY checkSeverity(lua_State * L, int index)
+{
+    if(lua_type(L, index) == LUA_TNUMBER)
+    {
+        const lua_Integer severity = luaL_checkinteger(L, index);
+        return static_cast<ECONSOLE_SEVERITY>(std::max<lua_Integer>(ECS_TRACE, std::min<lua_Integer>(ECS_OFF, severity)));
+    }
+
+    static const char * const names[] = {"trace", "debug", "info", "warning", "error", 0x0};
+    return static_cast<ECONSOLE_SEVERITY>(luaL_checkoption(L, index, 0x0, names));
+}
+
+static int ConsoleModel_echochannel(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    const lua_Integer channel = luaL_checkinteger(L, 1);
+    const ECONSOLE_SEVERITY severity = checkSeverity(L, 2);
+
+    //check before touching the message so nothing is formatted or called if it'd be dropped
+    if(!m || channel < 0 || !m->isChannelEnabled(static_cast<unsigned>(channel), severity))
+        return 0;
+
+    const int top = lua_gettop(L);
+    if(lua_type(L, 3) == LUA_TFUNCTION)
+    {
+        lua_call(L, top - 3, 1);
+    }
+    else if(top > 3)
+    {
+        lua_getglobal(L, "string");
+        lua_getfield(L, -1, "format");
+        lua_remove(L, -2);
+        lua_insert(L, 3);
+        lua_call(L, top - 2, 1);
+    }
+
+    std::size_t len;
+    const char * str = lua_tolstring(L, 3, &len);
+    if(!str)
+        return luaL_error(L, "echochannel message is not a string (and didn't produce one)");
+
+    m->echoChannel(static_cast<unsigned>(channel), severity, std::string(str, len));
+    return 0;
+}
+
+static int ConsoleModel_setredirect(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    if(m)
+        m->setRedirectOutput(lua_toboolean(L, 1));
+
+    return 0;
+}
+
+static int ConsoleModel_getredirect(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::checkFromUpvalue(L);
+    lua_pushboolean(L, m->getRedirectOutput());
+    return 1;
+}
+
+static int ConsoleModel_idle(lua_State * L)
+{
+    const double budget = luaL_checknumber(L, 1);
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    if(m)
+        m->idle(budget);
+
+    return 0;
+}
+
+static int ConsoleModel_setsuppressgc(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    if(m)
+        m->setSuppressAutoGc(lua_toboolean(L, 1));
+
+    return 0;
+}
+
+static int ConsoleModel_getsuppressgc(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::checkFromUpvalue(L);
+    lua_pushboolean(L, m->getSuppressAutoGc());
+    return 1;
+}
+
+//names of ECOMMAND_METRIC values, as fields of console.stats() tables
+const char * const kMetricNames[] = {"compile", "wall", "cpu", "memory", "gc"};
+
+static void pushHistogram(lua_State * L, const StatsHistogram& hist)
+{
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, static_cast<lua_Integer>(hist.Count));
+    lua_setfield(L, -2, "count");
+    lua_pushnumber(L, hist.Sum);
+    lua_setfield(L, -2, "sum");
+    lua_pushnumber(L, hist.Min);
+    lua_setfield(L, -2, "min");
+    lua_pushnumber(L, hist.Max);
+    lua_setfield(L, -2, "max");
+    lua_createtable(L, kStatsBucketCount, 0);
+    for(unsigned i = 0u; i < kStatsBucketCount; ++i)
+    {
+        lua_pushinteger(L, static_cast<lua_Integer>(hist.Buckets[i]));
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "buckets");
+}
+
+static int ConsoleModel_stats(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::checkFromUpvalue(L);
+    lua_createtable(L, 0, ECOMMAND_METRIC_COUNT + 1);
+    lua_createtable(L, 0, ECOMMAND_METRIC_COUNT);
+    for(int i = 0; i < ECOMMAND_METRIC_COUNT; ++i)
+    {
+        lua_pushnumber(L, m->getLastCommandStats().Values[i]);
+        lua_setfield(L, -2, kMetricNames[i]);
+    }
+    lua_setfield(L, -2, "last");
+
+    for(int i = 0; i < ECOMMAND_METRIC_COUNT; ++i)
+    {
+        pushHistogram(L, m->getCommandHistogram(static_cast<ECOMMAND_METRIC>(i)));
+        lua_setfield(L, -2, kMetricNames[i]);
+    }
+    return 1;
+}
+
+//functions that replace print, io.write and file write when output is
+//redirected all have 4 upvalues: console userdata, the original function,
+//io.stdout and io.output, when the console is gone they call the original
+
+static int callOriginalOutput(lua_State * L)
+{
+    const int top = lua_gettop(L);
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_insert(L, 1);
+    lua_call(L, top, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+//write strings and numbers from first to top, erroring on others like io.write does
+static void writeOutputArgs(lua_State * L, LuaConsoleModel * m, int first)
+{
+    const int top = lua_gettop(L);
+    for(int i = first; i <= top; ++i)
+    {
+        std::size_t len;
+        const char * str = luaL_checklstring(L, i, &len);
+        m->writeOutput(str, len);
+    }
+}
+
+static int ConsoleModel_print(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    if(!m)
+        return callOriginalOutput(L);
+
+    //same as print of 5.1, 5.2 and 5.3 does
+    const int top = lua_gettop(L);
+    lua_getglobal(L, "tostring");
+    for(int i = 1; i <= top; ++i)
+    {
+        lua_pushvalue(L, top + 1);
+        lua_pushvalue(L, i);
+        lua_call(L, 1, 1);
+
+        std::size_t len;
+        const char * str = lua_tolstring(L, -1, &len);
+        if(!str)
+            return luaL_error(L, "'tostring' must return a string to 'print'");
+
+        if(i > 1)
+            m->writeOutput("\t", 1u);
+
+        m->writeOutput(str, len);
+        lua_pop(L, 1);
+    }
+    m->writeOutput("\n", 1u);
+    return 0;
+}
+
+static int ConsoleModel_iowrite(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    if(!m)
+        return callOriginalOutput(L);
+
+    //script might have set default output to a file, then it's left alone
+    lua_pushvalue(L, lua_upvalueindex(4));
+    lua_call(L, 0, 1);
+    const bool tostdout = lua_rawequal(L, -1, lua_upvalueindex(3));
+    lua_pop(L, 1);
+    if(!tostdout)
+        return callOriginalOutput(L);
+
+    writeOutputArgs(L, m, 1);
+    lua_pushvalue(L, lua_upvalueindex(3));
+    return 1;
+}
+
+static int ConsoleModel_filewrite(lua_State * L)
+{
+    LuaConsoleModel * m = LuaConsoleModel::getFromUpvalue(L);
+    if(!m || !lua_rawequal(L, 1, lua_upvalueindex(3)))
+        return callOriginalOutput(L);
+
+    writeOutputArgs(L, m, 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+//replace function field name of table at index with closure of func that has
+//4 upvalues from first on and the original in between (see callOriginalOutput)
+static void replaceOutputFunction(lua_State * L, int table, const char * name, lua_CFunction func, int first)
+{
+    lua_getfield(L, table, name);
+
+    //might be redirected already, to us or to a console that's gone since
+    if(lua_tocfunction(L, -1) == func)
+    {
+        lua_getupvalue(L, -1, 2);
+        lua_remove(L, -2);
+    }
+
+    if(lua_isfunction(L, -1))
+    {
+        lua_pushvalue(L, first);
+        lua_pushvalue(L, -2);
+        lua_pushvalue(L, first + 1);
+        lua_pushvalue(L, first + 2);
+        lua_pushcclosure(L, func, 4);
+        lua_setfield(L, table, name);
+    }
+    lua_pop(L, 1);
+}
+
+//put back original function if field name of table at index is redirected
+static void restoreOutputFunction(lua_State * L, int table, const char * name, lua_CFunction func)
+{
+    lua_getfield(L, table, name);
+    if(lua_tocfunction(L, -1) == func)
+    {
+        lua_getupvalue(L, -1, 2);
+        lua_setfield(L, table, name);
+    }
+    lua_pop(L, 1);
+}
+
+static int ConsoleModel_gc(lua_State * L)
+{
+    LuaConsoleModel * m = *static_cast<LuaConsoleModel**>(lua_touserdata(L, 1));
+
+    //rationale: assume if our instance in registry and all references of it 
+    //got destroyed we are not able to or supposed to use the same L anymore
+    if(m)
+        m->setL(0x0);
+
+    return 0;
+}
+
+//the console library, see setL
+const luaL_Reg kConsoleLib[] = {
+    {"echo", &ConsoleModel_echo},
+    {"echocolored", &ConsoleModel_echocolored},
+    {"echolines", &ConsoleModel_echolines},
+    {"echospans", &ConsoleModel_echospans},
+    {"echomarkup", &ConsoleModel_echomarkup},
+    {"echochannel", &ConsoleModel_echochannel},
+    {"setcolor", &ConsoleModel_setcolor},
+    {"getcolor", &ConsoleModel_getcolor},
+    {"settitle", &ConsoleModel_settitle},
+    {"gettitle", &ConsoleModel_gettitle},
+    {"scroll", &ConsoleModel_scroll},
+    {"clear", &ConsoleModel_clear},
+    {"setvisible", &ConsoleModel_setvisible},
+    {"isvisible", &ConsoleModel_isvisible},
+    {"addhistory", &ConsoleModel_addhistory},
+    {"gethistory", &ConsoleModel_gethistory},
+    {"historysize", &ConsoleModel_historysize},
+    {"setredirect", &ConsoleModel_setredirect},
+    {"getredirect", &ConsoleModel_getredirect},
+    {"stats", &ConsoleModel_stats},
+    {"idle", &ConsoleModel_idle},
+    {"setsuppressgc", &ConsoleModel_setsuppressgc},
+    {"getsuppressgc", &ConsoleModel_getsuppressgc},
+    {0x0, 0x0}
+};
+
+void LuaConsoleModel::setL(lua_State * L)
+{
+    //references of inspected tables and pinned strings belong to the old state
+    if(this->L)
+    {
+        m_inspector->clear(this->L);
+        m_profiler->stop(this->L);
+        unpinMessages(true);
+        if(m_suppressgc)
+            lua_gc(this->L, LUA_GCRESTART, 0);
+    }
+
+    //what old state wrote goes before anything new one does
+    flushOutputLines(true);
+
+    //TODO: add support for more L's being linked/using echos at once??
+    this->L = L;
+
+    //clear and disarm, so the state that used us before is no longer able to
+    m_luaptr.clearLuaPointer();
+    m_luaptr.disarmLuaPointer();
+
+    if(L)
+    {
+        LuaConsoleModel ** ptr = static_cast<LuaConsoleModel**>(lua_newuserdata(L, sizeof (LuaConsoleModel*)));
+        (*ptr) = this;
+        m_luaptr.setLuaPointer(ptr);
+
+        //make and set new metatable with gc in it
+
+        luaL_newmetatable(L, kMetaname); //table
+        lua_pushliteral(L, "__gc");
+        lua_pushcfunction(L, &ConsoleModel_gc);
+        lua_settable(L, -3); //table[gc]=ConsoleModel_gc
+        lua_setmetatable(L, -2);
 
         lua_pushlightuserdata(L, getLightKey());
         lua_pushvalue(L, -2);
         lua_settable(L, LUA_REGISTRYINDEX);
 
-        lua_pushcclosure(L, &ConsoleModel_echo, 1);
-        lua_setglobal(L, "echo");
+        lua_pushvalue(L, -1);
+        lua_pushcclosure(L, &ConsoleModel_echo, 1);
+        lua_setglobal(L, "echo");
+
+        //we do reg manually because lua 5.2 deprecated register and 5.1
+        //doesnt have setfuncs yet, each function gets userdata as upvalue
+        lua_newtable(L); //console
+        lua_pushvalue(L, -2);
+        lua_setfield(L, -2, "handle");
+        for(int i = 0; kConsoleLib[i].name; ++i)
+        {
+            lua_pushvalue(L, -2);
+            lua_pushcclosure(L, kConsoleLib[i].func, 1);
+            lua_setfield(L, -2, kConsoleLib[i].name);
+        }
+        lua_setglobal(L, "console");
+
+        lua_pushcclosure(L, &ConsoleModel_echochannel, 1);
+        lua_setglobal(L, "echochannel");
+
+        priv::installGcCounter(L);
+        m_gccycles = priv::getGcCycles(L);
+        m_gcbase = 0.0;
+        m_gcincycle = false;
+        if(m_suppressgc)
+            lua_gc(L, LUA_GCSTOP, 0);
+
+        //before init, so what it prints ends up in console too
+        if(m_redirectoutput)
+            redirectOutput(true);
+
+        if(m_options & ECO_INIT)
+        {
+            if(luaL_loadfile(L, kInitFilename) || lua_pcall(L, 0, 1, 0))
+            {
+                echoColored(lua_tostring(L, -1), m_colors[ECC_ERROR]);
+                lua_pop(L, 1); //pop the error message
+                m_visible = true; //crapped up init is important so show console right away
+            }
+            else
+            {
+                m_visible = lua_toboolean(L, -1);
+                lua_pop(L, 1); //pop that boolean
+            }
+        }
+    }//if L
+}
+
+void LuaConsoleModel::tryComplete()
+{
+    if(!L)
+    {
+        //be nice and say there won't be any completions
+        echoColored("Lua state pointer is NULL, no completion available", m_colors[ECC_ERROR]);
+        return;
+    }
+
+    if(m_searching)
+        stopHistorySearch(true);
+
+    std::vector<std::string> possible; //possible matches
+    std::string last;
+
+    priv::prepareHints(L, m_lastline, last);
+    if(!priv::collectHints(L, possible, last, false))
+    {
+        //if no hints, assume we want _any_ completion and use global table
+        bla_lua_pushglobaltable(L);
+        priv::collectHints(L, possible, last, false);
+    }
+
+    lua_settop(L, 0); //pop all trash we put on the stack
+
+    if(possible.size() > 1u)
+    {
+        const std::string commonprefix = priv::commonPrefix(possible);
+        //if no common prefix or if we already have it or more
+        if(commonprefix.empty() || commonprefix.size() <= last.size())
+        {
+            std::string msg = possible[0];
+            for(std::size_t i = 1u; i < possible.size(); ++i)
+                msg += " " + possible[i];
+
+            echoColored(msg, m_colors[ECC_HINT]);
+        }
+        else
+        {
+            m_lastline += commonprefix.substr(last.size());
+            ++m_dirtyness;
+            moveCursor(kCursorEnd);
+        } //commonprefix is not empty
+    }
+    else if(possible.size() == 1)
+    {
+        //m_lastline.erase(m_lastline.size() - last.size());
+        m_lastline += possible[0].substr(last.size());
+        ++m_dirtyness;
+        moveCursor(kCursorEnd);
+    }
+}
+
+void LuaConsoleModel::setCallback(ECALLBACK_TYPE type, CallbackFunc func, void* data)
+{
+    if(type == ECALLBACK_TYPE_COUNT)
+        return;
+
+    m_callbackfuncs[type] = func;
+    m_callbackdata[type] = data;
+}
+
+void LuaConsoleModel::setVisible(bool visible)
+{
+    if(m_visible != visible)
+        ++m_dirtyness;
+
+    m_visible = visible;
+}
+
+bool LuaConsoleModel::isVisible() const
+{
+    return m_visible;
+}
+
+void LuaConsoleModel::toggleVisible()
+{
+    m_visible = !m_visible;
+    ++m_dirtyness;
+}
+
+void LuaConsoleModel::setColor(ECONSOLE_COLOR which, unsigned color)
+{
+    if(which != ECONSOLE_COLOR_COUNT && m_colors[which] != color)
+    {
+        m_colors[which] = color;
+        ++m_dirtyness;
+    }
+}
+
+unsigned LuaConsoleModel::getColor(ECONSOLE_COLOR which) const
+{
+    if(which == ECONSOLE_COLOR_COUNT)
+        return 0xffffffff;
+
+    return m_colors[which];
+}
+
+void LuaConsoleModel::setEnterRepeatLast(bool eer)
+{
+    m_emptyenterrepeat = eer;
+}
+
+bool LuaConsoleModel::getEnterRepeatLast() const
+{
+    return m_emptyenterrepeat;
+}
+
+ScreenCell * LuaConsoleModel::getCells(int x, int y) const
+{
+    assert(0 < x);
+    assert(x < 79);
+    assert(0 < y);
+    assert(y < 23);
+    return m_screen + x + 80 * y;
+}
+
+const ScreenCell* LuaConsoleModel::getScreenBuffer() const
+{
+    updateBuffer();
+    return m_screen;
+}
+
+void LuaConsoleModel::updateBuffer() const
+{
+    if(m_lastupdate == m_dirtyness)
+        return;
+
+    m_lastupdate = m_dirtyness;
+
+    //first we clear out the top bar
+    for(int i = 1; i < 79; ++i)
+        m_screen[i].Char = kVerticalBarChar;
+
+    //then we ensure frame is all OK colored, since setting title overwrites colors
+    for(int i = 0; i < 80; ++i)
+    {
+        m_screen[i + 0 * 80].Color = m_colors[ECC_FRAME];
+        m_screen[i + 23 * 80].Color = m_colors[ECC_FRAME];
+    }
+    for(int i = 0; i < 23; ++i)
+    {
+        m_screen[0 + i * 80].Color = m_colors[ECC_FRAME];
+        m_screen[79 + i * 80].Color = m_colors[ECC_FRAME];
+    }
+
+    //now we can set the title and its' color
+    for(int i = 1; i < std::min<int>(79, m_title.length() + 1); ++i)
+    {
+        m_screen[i].Char = m_title[i - 1];
+        m_screen[i].Color = m_colors[ECC_TITLE];
+    }
+
+
+    for(int i = 1; i < 22; ++i)
+    {
+        const priv::ColoredLine * line = &getWideLine(i - 22);
+
+        //lines from files might be broken, so never go past the line on screen
+        const char * l = line->getText();
+        const std::size_t size = line->Pinned?line->PinnedSize:std::min(line->Text.size(), line->Color.size());
+        std::size_t len = std::min<std::size_t>(size, kInnerWidth);
+
+        ScreenCell * a = getCells(1, i);
+
+        for(int x = 0; x < kInnerWidth; ++x)
+        {
+            a[x].Char = ' ';
+            a[x].Color = 0xffffffff;
+        }
+
+        for(std::size_t x = 0u; x < len; ++x)
+        {
+            a[x].Char = l[x];
+            a[x].Color = line->getColor(x);
+        }
+
+        //repeated line gets its' counter drawn at its' end, in color of its'
+        //last char, matches are then only highlighted in text before it
+        if(line->Repeats)
+        {
+            char suffix[32];
+            const std::size_t suffixsize = formatRepeatSuffix(*line, suffix);
+            const unsigned color = size?line->getColor(size - 1u):0xffffffff;
+            len = getRepeatSuffixStart(len, suffixsize);
+            for(std::size_t x = 0u; x < suffixsize; ++x)
+            {
+                a[len + x].Char = suffix[x];
+                a[len + x].Color = color;
+            }
+        }
+
+        //override colors of grep matches in this line, matches are sorted by line
+        const int index = getWideLineCount() + (i - 22) + m_firstmsg;
+        if(m_matches.empty() || index < 0)
+            continue;
+
+        priv::ScrollbackMatch key;
+        key.Archived = static_cast<std::size_t>(index) < getArchivedLineCount();
+        key.Line = key.Archived?index:m_cold->getBegin() + index - getArchivedLineCount();
+        std::vector<priv::ScrollbackMatch>::const_iterator it;
+        it = std::lower_bound(m_matches.begin(), m_matches.end(), key, matchLineLess);
+        for(; it != m_matches.end() && it->Archived == key.Archived && it->Line == key.Line; ++it)
+            for(std::size_t x = it->Start; x < it->Start + m_grep.size() && x < len; ++x)
+                a[x].Color = m_colors[ECC_MATCH];
+    }
+
+    ScreenCell * a = getCells(1, 22);
 
-        if(m_options & ECO_INIT)
+    for(int x = 0; x < kInnerWidth; ++x)
+    {
+        a[x].Char = ' ';
+        a[x].Color = m_colors[ECC_PROMPT];
+    }
+
+    if(m_searching)
+    {
+        const std::string prompt = getSearchPrompt();
+        for(std::size_t x = 0; x < kInnerWidth && x < prompt.size(); ++x)
+            a[x].Char = prompt[x];
+
+        return;
+    }
+
+    for(std::size_t x = 0; x < kInnerWidth && (m_lastlineoffset + x) < m_lastline.size(); ++x)
+    {
+        a[x].Char = m_lastline[m_lastlineoffset + x];
+    }
+
+    //suggestion only makes sense when typing at the end of the line
+    const std::string * suggestion = 0x0;
+    if(static_cast<std::size_t>(m_cur) == m_lastline.size() + 1u)
+        suggestion = findSuggestion();
+
+    if(suggestion)
+    {
+        for(std::size_t x = m_lastline.size() - m_lastlineoffset, i = m_lastline.size();
+            x < kInnerWidth && i < suggestion->size(); ++x, ++i)
         {
-            if(luaL_loadfile(L, kInitFilename) || lua_pcall(L, 0, 1, 0))
-            {
-                echoColored(lua_tostring(L, -1), m_colors[ECC_ERROR]);
-                lua_pop(L, 1); //pop the error message
-                m_visible = true; //crapped up init is important so show console right away
-            }
-            else
-            {
-                m_visible = lua_toboolean(L, -1);
-                lua_pop(L, 1); //pop that boolean
-            }
+            a[x].Char = (*suggestion)[i];
+            a[x].Color = m_colors[ECC_SUGGESTION];
         }
-    }//if L
+    }
 }
 
-void LuaConsoleModel::tryComplete()
+void LuaConsoleModel::setRedirectOutput(bool redirect)
 {
-    if(!L)
+    m_redirectoutput = redirect;
+    if(L)
+        redirectOutput(redirect);
+}
+
+bool LuaConsoleModel::getRedirectOutput() const
+{
+    return m_redirectoutput;
+}
+
+//replace print, io.write and write of io.stdout's methods or put back the
+//originals, missing io library or io.stdout is fine, only print is done then
+void LuaConsoleModel::redirectOutput(bool redirect)
+{
+    const int top = lua_gettop(L);
+    bla_lua_pushglobaltable(L); //top + 1
+    lua_getglobal(L, "io"); //top + 2
+
+    //upvalues of the new functions
+    lua_pushlightuserdata(L, getLightKey());
+    lua_gettable(L, LUA_REGISTRYINDEX); //top + 3
+    const bool hasio = lua_istable(L, top + 2);
+    if(hasio)
     {
-        //be nice and say there won't be any completions
-        echoColored("Lua state pointer is NULL, no completion available", m_colors[ECC_ERROR]);
+        lua_getfield(L, top + 2, "stdout"); //top + 4
+        lua_getfield(L, top + 2, "output"); //top + 5
+    }
+    else
+    {
+        lua_pushnil(L);
+        lua_pushnil(L);
+    }
+
+    //file methods are in __index of the metatable shared by all files
+    if(lua_getmetatable(L, top + 4))
+    {
+        lua_getfield(L, -1, "__index"); //top + 7
+    }
+    else
+    {
+        lua_pushnil(L);
+        lua_pushnil(L);
+    }
+
+    const bool hasfile = lua_istable(L, top + 7);
+    const bool haswrite = hasio && lua_isfunction(L, top + 5) && !lua_isnil(L, top + 4);
+    if(redirect)
+    {
+        replaceOutputFunction(L, top + 1, "print", &ConsoleModel_print, top + 3);
+        if(haswrite)
+            replaceOutputFunction(L, top + 2, "write", &ConsoleModel_iowrite, top + 3);
+
+        if(hasfile && haswrite)
+            replaceOutputFunction(L, top + 7, "write", &ConsoleModel_filewrite, top + 3);
+    }
+    else
+    {
+        restoreOutputFunction(L, top + 1, "print", &ConsoleModel_print);
+        if(hasio)
+            restoreOutputFunction(L, top + 2, "write", &ConsoleModel_iowrite);
+
+        if(hasfile)
+            restoreOutputFunction(L, top + 7, "write", &ConsoleModel_filewrite);
+    }
+    lua_settop(L, top);
+}
+
+const std::string& LuaConsoleModel::getTitle() const
+{
+    return m_title;
+}
+
+void LuaConsoleModel::setTitle(const std::string& title)
+{
+    if(m_title != title)
+        ++m_dirtyness;
+
+    m_title = title;
+}
+
+void LuaConsoleModel::setHistoryCapacity(std::size_t newcapacity)
+{
+    if(newcapacity == m_history.size())
+        return;
+
+    //keep the newest items that fit, linearized so oldest is at 0 again
+    const std::size_t kept = std::min(m_hsize, newcapacity);
+    std::vector<std::string> history(newcapacity);
+    for(std::size_t i = 0u; i < kept; ++i)
+        history[i].swap(m_history[(m_hstart + m_hsize - kept + i) % m_history.size()]);
+
+    m_history.swap(history);
+    m_hstart = 0u;
+    m_hsize = kept;
+    m_hindex = std::min<int>(m_hindex, m_hsize);
+    m_hjournal->setKeepLines(newcapacity);
+}
+
+std::size_t LuaConsoleModel::getHistoryCapacity() const
+{
+    return m_history.size();
+}
+
+void LuaConsoleModel::setHistorySize(std::size_t newsize)
+{
+    setHistoryCapacity(newsize);
+}
+
+void LuaConsoleModel::addHistoryItem(const std::string& item)
+{
+    if(m_history.empty())
         return;
+
+    if(m_hindexdirty)
+        reindexHistory();
+
+    if(m_hsize < m_history.size())
+    {
+        m_history[(m_hstart + m_hsize) % m_history.size()] = item;
+        ++m_hsize;
+    }
+    else
+    {
+        //full, so overwrite the oldest and make the next one oldest
+        m_history[m_hstart] = item;
+        m_hstart = (m_hstart + 1u) % m_history.size();
     }
 
-    std::vector<std::string> possible; //possible matches
-    std::string last;
+    m_hsearchindex->add(m_hnext, item);
+    m_hprefixtrie->add(m_hnext, item);
+    ++m_hnext;
 
-    priv::prepareHints(L, m_lastline, last);
-    if(!priv::collectHints(L, possible, last, false))
+    //drop postings and trie nodes of items that fell out of history once per
+    //capacity worth of new items, so it's amortized and they don't grow forever
+    if(m_hnext - m_hlastprune > m_history.size())
     {
-        //if no hints, assume we want _any_ completion and use global table
-        bla_lua_pushglobaltable(L);
-        priv::collectHints(L, possible, last, false);
+        m_hsearchindex->prune(m_hnext - m_hsize);
+        m_hprefixtrie->clear();
+        for(std::size_t i = 0u; i < m_hsize; ++i)
+            m_hprefixtrie->add(m_hnext - m_hsize + i, getHistoryItem(i));
+
+        m_hlastprune = m_hnext;
     }
+}
 
-    lua_settop(L, 0); //pop all trash we put on the stack
+void LuaConsoleModel::setHistoryItem(std::size_t index, const std::string& item)
+{
+    if(index < m_hsize)
+    {
+        m_history[(m_hstart + index) % m_history.size()] = item;
+        m_hindexdirty = true;
+    }
+}
 
-    if(possible.size() > 1u)
+void LuaConsoleModel::setHistorySuggestions(bool suggest)
+{
+    if(m_hsuggest != suggest)
+        ++m_dirtyness;
+
+    m_hsuggest = suggest;
+}
+
+bool LuaConsoleModel::getHistorySuggestions() const
+{
+    return m_hsuggest;
+}
+
+std::size_t LuaConsoleModel::getHistorySize() const
+{
+    return m_hsize;
+}
+
+const std::string& LuaConsoleModel::getHistoryItem(std::size_t index) const
+{
+    if(index < m_hsize)
+        return m_history[(m_hstart + index) % m_history.size()];
+
+    return m_empty.Text;
+}
+
+void LuaConsoleModel::setHistoryIgnoreDups(bool ignore)
+{
+    m_hignoredups = ignore;
+}
+
+bool LuaConsoleModel::getHistoryIgnoreDups() const
+{
+    return m_hignoredups;
+}
+
+const std::string& LuaConsoleModel::getHistoryItemBySeq(std::size_t seq) const
+{
+    return getHistoryItem(seq - (m_hnext - m_hsize));
+}
+
+const std::string& LuaConsoleModel::historyItemBySeq(std::size_t seq, void * data)
+{
+    return static_cast<const LuaConsoleModel*>(data)->getHistoryItemBySeq(seq);
+}
+
+void LuaConsoleModel::runHistorySearch(std::size_t before, bool skipmatch)
+{
+    if(m_hindexdirty)
+        reindexHistory();
+
+    ++m_dirtyness;
+    if(m_searchquery.empty())
     {
-        const std::string commonprefix = priv::commonPrefix(possible);
-        //if no common prefix or if we already have it or more
-        if(commonprefix.empty() || commonprefix.size() <= last.size())
+        m_searchmatch = m_hnext;
+        m_searchfailed = false;
+        return;
+    }
+
+    //skip lines equal to current match so each Ctrl + R gives a new command
+    const std::string * skip = 0x0;
+    if(skipmatch && m_searchmatch != m_hnext)
+        skip = &getHistoryItemBySeq(m_searchmatch);
+
+    const std::size_t found = m_hsearchindex->findNewest(m_searchquery, m_hnext - m_hsize,
+                                                         before, skip, &historyItemBySeq, this);
+
+    //on failure keep showing the last match, like bash does
+    m_searchfailed = (found == before);
+    if(!m_searchfailed)
+        m_searchmatch = found;
+}
+
+//drop all history items, indices get cleared on the next add
+void LuaConsoleModel::clearHistoryItems()
+{
+    m_hstart = 0u;
+    m_hsize = 0u;
+    m_hindex = 0;
+    m_hindexdirty = true;
+}
+
+void LuaConsoleModel::reindexHistory()
+{
+    //items were edited in place, reindex all of them, this is rare
+    m_hsearchindex->clear();
+    m_hprefixtrie->clear();
+    for(std::size_t i = 0u; i < m_hsize; ++i)
+    {
+        m_hsearchindex->add(m_hnext - m_hsize + i, getHistoryItem(i));
+        m_hprefixtrie->add(m_hnext - m_hsize + i, getHistoryItem(i));
+    }
+
+    m_hindexdirty = false;
+    m_hlastprune = m_hnext;
+}
+
+const std::string * LuaConsoleModel::findSuggestion() const
+{
+    if(!m_hsuggest || m_searching || m_lastline.empty())
+        return 0x0;
+
+    //newest item with this prefix fell out of history so all others did too
+    const std::size_t seq = m_hprefixtrie->findNewest(m_lastline, m_hnext);
+    if(seq == m_hnext || seq < m_hnext - m_hsize)
+        return 0x0;
+
+    //trie might be stale if history was edited in place and not reindexed yet
+    const std::string& item = getHistoryItemBySeq(seq);
+    if(item.size() <= m_lastline.size() || item.compare(0u, m_lastline.size(), m_lastline) != 0)
+        return 0x0;
+
+    return &item;
+}
+
+std::string LuaConsoleModel::getSearchPrompt() const
+{
+    std::string ret = m_searchfailed?kFailedSearchPrompt:kSearchPrompt;
+    ret += m_searchquery;
+    ret += "': ";
+    if(m_searchmatch != m_hnext)
+        ret += getHistoryItemBySeq(m_searchmatch);
+
+    return ret;
+}
+
+void LuaConsoleModel::searchHistory()
+{
+    if(m_searching)
+    {
+        runHistorySearch(m_searchmatch, true);
+        return;
+    }
+
+    pollHistoryJournal();
+
+    m_searching = true;
+    m_searchfailed = false;
+    m_searchquery.clear();
+    m_searchmatch = m_hnext;
+    m_presearchline = m_lastline;
+    ++m_dirtyness;
+}
+
+void LuaConsoleModel::stopHistorySearch(bool accept)
+{
+    if(!m_searching)
+        return;
+
+    m_searching = false;
+    if(accept && m_searchmatch != m_hnext)
+        m_lastline = getHistoryItemBySeq(m_searchmatch);
+    else
+        m_lastline = m_presearchline;
+
+    m_hindex = getHistorySize();
+    m_lastlineoffset = 0u;
+    moveCursor(kCursorEnd);
+}
+
+bool LuaConsoleModel::isSearchingHistory() const
+{
+    return m_searching;
+}
+
+bool LuaConsoleModel::loadHistoryFromFile(const std::string& filename, bool append)
+{
+#ifndef _WIN32
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0 || getHistoryCapacity() == 0u)
+    {
+        close(fd);
+        return false;
+    }
+
+    const std::size_t size = st.st_size;
+    void * map = mmap(0x0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return false;
+
+    //last newline just ends the last line, it doesn't start an empty one
+    const char * data = static_cast<const char*>(map);
+    std::size_t end = size;
+    if(data[end - 1u] == '\n')
+        --end;
+
+    //walk back from the end until we passed as many lines as we can keep
+    std::size_t start = end;
+    std::size_t lines = 0u;
+    while(start > 0u)
+    {
+        if(data[start - 1u] == '\n' && ++lines == getHistoryCapacity())
+            break;
+
+        --start;
+    }
+
+    //and then add them oldest first
+    if(!append)
+        clearHistoryItems();
+
+    std::size_t linestart = start;
+    for(std::size_t i = start; i <= end; ++i)
+    {
+        if(i == end || data[i] == '\n')
         {
-            std::string msg = possible[0];
-            for(std::size_t i = 1u; i < possible.size(); ++i)
-                msg += " " + possible[i];
+            //header of a compacted journal file is not a history item
+            if(linestart != 0u || !priv::isJournalHeader(data, i))
+                addHistoryItem(std::string(data + linestart, i - linestart));
 
-            echoColored(msg, m_colors[ECC_HINT]);
+            linestart = i + 1u;
         }
-        else
-        {
-            m_lastline += commonprefix.substr(last.size());
-            ++m_dirtyness;
-            moveCursor(kCursorEnd);
-        } //commonprefix is not empty
     }
-    else if(possible.size() == 1)
+
+    munmap(map, size);
+    m_hindex = getHistorySize();
+    return true;
+#else //_WIN32
+    std::ifstream file(filename.c_str());
+    if(!file.is_open())
+        return false;
+
+    if(getHistoryCapacity() == 0u)
+        return false;
+
+    std::string line;
+    std::size_t iter = 0u;
+
+    //ring drops the oldest as it goes so only last capacity lines are kept
+    while(std::getline(file, line))
     {
-        //m_lastline.erase(m_lastline.size() - last.size());
-        m_lastline += possible[0].substr(last.size());
-        ++m_dirtyness;
-        moveCursor(kCursorEnd);
+        if(iter == 0u && !append)
+            clearHistoryItems();
+
+        //header of a compacted journal file is not a history item
+        if(iter != 0u || !priv::isJournalHeader(line.c_str(), line.size()))
+            addHistoryItem(line);
+
+        ++iter;
     }
+
+    m_hindex = getHistorySize();
+    return iter != 0u;
+#endif //_WIN32
+}
+
+void LuaConsoleModel::saveHistoryToFile(const std::string& filename, bool append)
+{
+    //no endl, flushing once when file closes is enough
+    std::ofstream file(filename.c_str(), append?std::ios::app:std::ios::trunc);
+    for(std::size_t i = 0u; i < getHistorySize(); ++i)
+        file << getHistoryItem(i) << '\n';
+}
+
+bool LuaConsoleModel::openHistoryJournal(const std::string& filename)
+{
+    return m_hjournal->open(filename, getHistoryCapacity());
 }
 
-void LuaConsoleModel::setCallback(ECALLBACK_TYPE type, CallbackFunc func, void* data)
+void LuaConsoleModel::closeHistoryJournal()
 {
-    if(type == ECALLBACK_TYPE_COUNT)
-        return;
+    m_hjournal->close();
+}
 
-    m_callbackfuncs[type] = func;
-    m_callbackdata[type] = data;
+bool LuaConsoleModel::isHistoryJournalOpen() const
+{
+    return m_hjournal->isOpen();
 }
 
-void LuaConsoleModel::setVisible(bool visible)
+void LuaConsoleModel::pollHistoryJournal()
 {
-    if(m_visible != visible)
-        ++m_dirtyness;
+    if(!m_hjournal->isOpen())
+        return;
 
-    m_visible = visible;
+    std::vector<std::string> lines;
+    m_hjournal->takeIncoming(lines);
+    for(std::size_t i = 0u; i < lines.size(); ++i)
+        addHistoryItem(lines[i]);
 }
 
-bool LuaConsoleModel::isVisible() const
+void LuaConsoleModel::setSkipCharacters(const std::string& chars)
 {
-    return m_visible;
+    m_skipchars = chars;
 }
 
-void LuaConsoleModel::toggleVisible()
+const std::string& LuaConsoleModel::getSkipCharacters() const
 {
-    m_visible = !m_visible;
-    ++m_dirtyness;
+    return m_skipchars;
 }
 
-void LuaConsoleModel::setColor(ECONSOLE_COLOR which, unsigned color)
+void LuaConsoleModel::setPrintEval(bool print)
 {
-    if(which != ECONSOLE_COLOR_COUNT && m_colors[which] != color)
-    {
-        m_colors[which] = color;
-        ++m_dirtyness;
-    }
+    m_printeval = print;
 }
 
-unsigned LuaConsoleModel::getColor(ECONSOLE_COLOR which) const
+bool LuaConsoleModel::getPrintEval() const
 {
-    if(which == ECONSOLE_COLOR_COUNT)
-        return 0xffffffff;
-
-    return m_colors[which];
+    return m_printeval;
 }
 
-void LuaConsoleModel::setEnterRepeatLast(bool eer)
+void LuaConsoleModel::setPrintEvalLimits(std::size_t depth, std::size_t items, std::size_t bytes)
 {
-    m_emptyenterrepeat = eer;
+    m_printdepth = depth;
+    m_printitems = items;
+    m_printbytes = bytes;
 }
 
-bool LuaConsoleModel::getEnterRepeatLast() const
+std::size_t LuaConsoleModel::getPrintEvalDepth() const
 {
-    return m_emptyenterrepeat;
+    return m_printdepth;
 }
 
-ScreenCell * LuaConsoleModel::getCells(int x, int y) const
+std::size_t LuaConsoleModel::getPrintEvalItems() const
 {
-    assert(0 < x);
-    assert(x < 79);
-    assert(0 < y);
-    assert(y < 23);
-    return m_screen + x + 80 * y;
+    return m_printitems;
 }
 
-const ScreenCell* LuaConsoleModel::getScreenBuffer() const
+std::size_t LuaConsoleModel::getPrintEvalBytes() const
 {
-    updateBuffer();
-    return m_screen;
+    return m_printbytes;
 }
 
-void LuaConsoleModel::updateBuffer() const
+void LuaConsoleModel::setInspectResults(bool inspect)
 {
-    if(m_lastupdate == m_dirtyness)
-        return;
-
-    m_lastupdate = m_dirtyness;
-
-    //first we clear out the top bar
-    for(int i = 1; i < 79; ++i)
-        m_screen[i].Char = kVerticalBarChar;
+    m_inspect = inspect;
+}
 
-    //then we ensure frame is all OK colored, since setting title overwrites colors
-    for(int i = 0; i < 80; ++i)
-    {
-        m_screen[i + 0 * 80].Color = m_colors[ECC_FRAME];
-        m_screen[i + 23 * 80].Color = m_colors[ECC_FRAME];
-    }
-    for(int i = 0; i < 23; ++i)
-    {
-        m_screen[0 + i * 80].Color = m_colors[ECC_FRAME];
-        m_screen[79 + i * 80].Color = m_colors[ECC_FRAME];
-    }
+bool LuaConsoleModel::getInspectResults() const
+{
+    return m_inspect;
+}
 
-    //now we can set the title and its' color
-    for(int i = 1; i < std::min<int>(79, m_title.length() + 1); ++i)
-    {
-        m_screen[i].Char = m_title[i - 1];
-        m_screen[i].Color = m_colors[ECC_TITLE];
-    }
+void LuaConsoleModel::openInspectedTable(unsigned id)
+{
+    echoInspectedPage(id, true);
+}
 
+void LuaConsoleModel::moreInspectedTable(unsigned id)
+{
+    echoInspectedPage(id, false);
+}
 
-    for(int i = 1; i < 22; ++i)
-    {
-        const std::string& l = getWideMsg(i - 22);
-        const ColorString& c = getWideColor(i - 22);
+void LuaConsoleModel::closeInspectedTable(unsigned id)
+{
+    if(L)
+        m_inspector->close(L, id);
+}
 
-        ScreenCell * a = getCells(1, i);
+void LuaConsoleModel::setShowCommandStats(bool show)
+{
+    m_showstats = show;
+}
 
-        for(int x = 0; x < kInnerWidth; ++x)
-        {
-            a[x].Char = ' ';
-            a[x].Color = 0xffffffff;
-        }
+bool LuaConsoleModel::getShowCommandStats() const
+{
+    return m_showstats;
+}
 
-        for(std::size_t x = 0u; x < l.size(); ++x)
-        {
-            a[x].Char = l[x];
-            a[x].Color = c[x];
-        }
-    }
+const CommandStats& LuaConsoleModel::getLastCommandStats() const
+{
+    return m_laststats;
+}
 
-    ScreenCell * a = getCells(1, 22);
+const StatsHistogram& LuaConsoleModel::getCommandHistogram(ECOMMAND_METRIC metric) const
+{
+    return m_stathists[metric];
+}
 
-    for(int x = 0; x < kInnerWidth; ++x)
+void LuaConsoleModel::resetCommandStats()
+{
+    for(int i = 0; i < ECOMMAND_METRIC_COUNT; ++i)
     {
-        a[x].Char = ' ';
-        a[x].Color = m_colors[ECC_PROMPT];
+        m_laststats.Values[i] = 0.0;
+        priv::clearHistogram(m_stathists[i]);
     }
+}
 
-    for(std::size_t x = 0; x < kInnerWidth && (m_lastlineoffset + x) < m_lastline.size(); ++x)
+void LuaConsoleModel::recordCommandStats(const CommandStats& stats)
+{
+    //times go into buckets in microseconds
+    m_laststats = stats;
+    for(int i = 0; i < ECOMMAND_METRIC_COUNT; ++i)
     {
-        a[x].Char = m_lastline[m_lastlineoffset + x];
+        const bool time = i == ECM_COMPILE || i == ECM_WALL || i == ECM_CPU;
+        priv::addToHistogram(m_stathists[i], stats.Values[i], time?1e6:1.0);
     }
-}
 
-const std::string& LuaConsoleModel::getTitle() const
-{
-    return m_title;
+    if(m_showstats)
+        echoColored(priv::formatCommandStats(stats), m_colors[ECC_STATS]);
 }
 
-void LuaConsoleModel::setTitle(const std::string& title)
+bool LuaConsoleModel::startProfiler(double interval)
 {
-    if(m_title != title)
-        ++m_dirtyness;
-
-    m_title = title;
+    return L && m_profiler->start(L, interval);
 }
 
-void LuaConsoleModel::setHistorySize(std::size_t newsize)
+void LuaConsoleModel::stopProfiler()
 {
-    m_history.resize(newsize);
+    if(L)
+        m_profiler->stop(L);
 }
 
-void LuaConsoleModel::setHistoryItem(std::size_t index, const std::string& item)
+bool LuaConsoleModel::isProfilerRunning() const
 {
-    if(index < m_history.size())
-        m_history[index] = item;
+    return m_profiler->isRunning();
 }
 
-std::size_t LuaConsoleModel::getHistorySize() const
+void LuaConsoleModel::reportProfile(std::size_t count)
 {
-    return m_history.size();
+    std::vector<std::string> rows;
+    m_profiler->report(count, rows);
+    for(std::size_t i = 0u; i < rows.size(); ++i)
+        echoColored(rows[i], m_colors[ECC_STATS]);
 }
 
-const std::string& LuaConsoleModel::getHistoryItem(std::size_t index) const
+void LuaConsoleModel::timeCode(const std::string& code, std::size_t calls, double budget)
 {
-    if(index < m_history.size())
-        return m_history[index];
+    if(!L)
+        return echoColored("Lua state pointer is NULL, can't time code", m_colors[ECC_ERROR]);
 
-    return m_empty.Text;
+    const int oldtop = lua_gettop(L);
+    const std::string withreturn = "return " + code;
+    if(BLA_LUA_OK != luaL_loadstring(L, withreturn.c_str()))
+    {
+        lua_pop(L, 1);
+        if(BLA_LUA_OK != luaL_loadstring(L, code.c_str()))
+        {
+            echoColored(lua_tostring(L, -1), m_colors[ECC_ERROR]);
+            return lua_settop(L, oldtop);
+        }
+    }
+
+    priv::BenchmarkResult result;
+    const bool ok = priv::runBenchmark(L, calls, budget, result);
+
+    //5.1 can't tell it was stopped so benchmark restarted it
+    if(m_suppressgc)
+        lua_gc(L, LUA_GCSTOP, 0);
+
+    if(ok)
+        echoColored(priv::formatBenchmark(result), m_colors[ECC_STATS]);
+    else
+        echoColored(lua_isstring(L, -1)?lua_tostring(L, -1):"(error object is not a string)", m_colors[ECC_ERROR]);
+
+    lua_settop(L, oldtop);
 }
 
-bool LuaConsoleModel::loadHistoryFromFile(const std::string& filename)
+//how much lua memory has to grow over what was in use after the last cycle
+//for idle to start a new one, automatic collector waits for 100% by default
+const double kIdleGcGrowth = 0.5;
+
+void LuaConsoleModel::idle(double budget)
 {
-    std::ifstream file(filename.c_str());
-    if(!file.is_open())
-        return false;
+    //lines echoed outside of batches are written to scrollback file here
+    m_sbfile->flush();
+    if(!L)
+        return;
 
-    if(getHistorySize() == 0u)
-        return false;
+    const double start = priv::getWallSeconds();
+    const double end = start + budget;
+    double now = start;
+    ++m_idlestats.Calls;
 
-    std::vector<std::string> buf(getHistorySize());
-    std::string line;
-    std::size_t iter = 0u;
+    //cycles we didn't finish ourselves, since the last call
+    const std::size_t cycles = priv::getGcCycles(L);
+    if(cycles != m_gccycles)
+    {
+        m_idlestats.OtherCycles += cycles - m_gccycles;
+        m_gcincycle = false;
+        m_gcbase = priv::getLuaMemory(L);
+    }
 
-    while(std::getline(file, line))
+    if(m_gcincycle || priv::getLuaMemory(L) >= m_gcbase * (1.0 + kIdleGcGrowth))
     {
-        buf[iter % getHistorySize()] = line;
-        ++iter;
+        while(now < end)
+        {
+            const int finished = lua_gc(L, LUA_GCSTEP, 0);
+            const double after = priv::getWallSeconds();
+            priv::addToHistogram(m_idlestats.Steps, after - now, 1e6);
+            now = after;
+            m_gcincycle = !finished;
+            if(finished)
+            {
+                ++m_idlestats.Cycles;
+                m_gcbase = priv::getLuaMemory(L);
+                break;
+            }
+        }
+
+        //5.1 restarts automatic collector on each step
+        if(m_suppressgc)
+            lua_gc(L, LUA_GCSTOP, 0);
     }
 
-    if(iter == 0u)
-        return false;
+    //our own cycles moved the counter too
+    m_gccycles = priv::getGcCycles(L);
+    m_idlestats.LastSeconds = now - start;
+    m_idlestats.MaxOverrun = std::max(m_idlestats.MaxOverrun, now - end);
+}
 
-    for(std::size_t i = 0; i < getHistorySize(); ++i)
-        m_history[i] = buf[(iter + i) % getHistorySize()];
+void LuaConsoleModel::setSuppressAutoGc(bool suppress)
+{
+    if(L && suppress != m_suppressgc)
+        lua_gc(L, suppress?LUA_GCSTOP:LUA_GCRESTART, 0);
 
-    return true;
+    m_suppressgc = suppress;
 }
 
-void LuaConsoleModel::saveHistoryToFile(const std::string& filename, bool append)
+bool LuaConsoleModel::getSuppressAutoGc() const
 {
-    std::ofstream file(filename.c_str(), append?std::ios::app:std::ios::trunc);
-    for(std::size_t i = 0u; i < getHistorySize(); ++i)
-        file << getHistoryItem(i) << std::endl;
+    return m_suppressgc;
 }
 
-void LuaConsoleModel::setSkipCharacters(const std::string& chars)
+const IdleGcStats& LuaConsoleModel::getIdleGcStats() const
 {
-    m_skipchars = chars;
+    return m_idlestats;
 }
 
-const std::string& LuaConsoleModel::getSkipCharacters() const
+void LuaConsoleModel::resetIdleGcStats()
 {
-    return m_skipchars;
+    m_idlestats.Calls = 0u;
+    m_idlestats.Cycles = 0u;
+    m_idlestats.OtherCycles = 0u;
+    m_idlestats.LastSeconds = 0.0;
+    m_idlestats.MaxOverrun = 0.0;
+    priv::clearHistogram(m_idlestats.Steps);
 }
 
-void LuaConsoleModel::setPrintEval(bool print)
+void LuaConsoleModel::echoGcStats()
 {
-    m_printeval = print;
+    if(!L)
+        return echoColored("Lua state pointer is NULL, no gc stats", m_colors[ECC_ERROR]);
+
+    std::vector<std::string> rows;
+    const double memory = priv::getLuaMemory(L);
+    priv::formatIdleGcStats(m_idlestats, memory, memory - m_gcbase, m_suppressgc, rows);
+    for(std::size_t i = 0u; i < rows.size(); ++i)
+        echoColored(rows[i], m_colors[ECC_STATS]);
 }
 
-bool LuaConsoleModel::getPrintEval() const
+void LuaConsoleModel::setCommandMemoryLimit(std::size_t bytes)
 {
-    return m_printeval;
+    m_cmdmemlimit = bytes;
+}
+
+std::size_t LuaConsoleModel::getCommandMemoryLimit() const
+{
+    return m_cmdmemlimit;
 }
 
 void LuaConsoleModel::setAddReturn(bool add)
@@ -911,7 +3163,164 @@ void LuaConsoleModel::clearScreen()
 {
     m_firstmsg = 0;
     m_msg.clear();
+    unpinMessages(false);
+    m_unwrapped = 0u;
+    m_widedropped += m_widemsg.size();
     m_widemsg.clear();
+    m_matches.clear();
+    m_cold->clear(m_widedropped);
+    m_sbfile->dropArchived();
+}
+
+void LuaConsoleModel::setColdScrollbackLines(std::size_t lines)
+{
+    m_cold->setMaxLines(lines);
+    scrollLines(0);
+}
+
+std::size_t LuaConsoleModel::getColdScrollbackLines() const
+{
+    return m_cold->getMaxLines();
+}
+
+void LuaConsoleModel::setColdScrollbackMemoryBlocks(std::size_t blocks)
+{
+    m_cold->setMemoryBlocks(blocks);
+}
+
+std::size_t LuaConsoleModel::getColdScrollbackMemoryBlocks() const
+{
+    return m_cold->getMemoryBlocks();
+}
+
+bool LuaConsoleModel::openScrollbackFile(const std::string& filename)
+{
+    dropArchivedMatches();
+    const bool ret = m_sbfile->open(filename, m_sbfilelines);
+    scrollLines(0);
+    return ret;
+}
+
+void LuaConsoleModel::closeScrollbackFile()
+{
+    dropArchivedMatches();
+    m_sbfile->close();
+    scrollLines(0);
+}
+
+bool LuaConsoleModel::isScrollbackFileOpen() const
+{
+    return m_sbfile->isOpen();
+}
+
+void LuaConsoleModel::setScrollbackFileLines(std::size_t lines)
+{
+    m_sbfilelines = lines;
+}
+
+std::size_t LuaConsoleModel::getScrollbackFileLines() const
+{
+    return m_sbfilelines;
+}
+
+void LuaConsoleModel::setCollapseRepeats(bool collapse)
+{
+    m_collapserepeats = collapse;
+}
+
+bool LuaConsoleModel::getCollapseRepeats() const
+{
+    return m_collapserepeats;
+}
+
+std::size_t LuaConsoleModel::grepScrollback(const std::string& text)
+{
+    wrapMessages();
+    return grepWideLines(text, m_widemsg.size());
+}
+
+std::size_t LuaConsoleModel::grepWideLines(const std::string& text, std::size_t count)
+{
+    m_grep = text;
+    m_matches.clear();
+    ++m_dirtyness;
+    if(m_grep.empty())
+        return 0u;
+
+    //oldest first, so matches come out sorted, cold lines are asked for in
+    //order so each of its' blocks gets decompressed just once
+    for(std::size_t i = 0u; i < getArchivedLineCount(); ++i)
+        grepLine(m_sbfile->getArchivedLine(i), m_grep, true, i, m_matches);
+
+    for(std::size_t i = m_cold->getBegin(); i < m_cold->getEnd(); ++i)
+        grepLine(m_cold->getLine(i), m_grep, false, i, m_matches);
+
+    for(std::size_t i = 0u; i < count; ++i)
+        grepLine(m_widemsg[i], m_grep, false, m_widedropped + i, m_matches);
+
+    m_curmatch = m_matches.size() - 1u; //newest, if none then nothing is shown
+    showCurrentMatch();
+    return m_matches.size();
+}
+
+bool LuaConsoleModel::isMatchGone(const priv::ScrollbackMatch& match) const
+{
+    if(match.Archived)
+        return match.Line >= getArchivedLineCount();
+
+    return match.Line < m_cold->getBegin();
+}
+
+//archive lines are numbered from first line of the archive, so when it's gone
+//or replaced these matches point at wrong lines
+void LuaConsoleModel::dropArchivedMatches()
+{
+    std::size_t archived = 0u;
+    while(archived < m_matches.size() && m_matches[archived].Archived)
+        ++archived;
+
+    m_matches.erase(m_matches.begin(), m_matches.begin() + archived);
+    m_curmatch = (m_curmatch < archived)?0u:m_curmatch - archived;
+}
+
+void LuaConsoleModel::jumpToMatch(int change)
+{
+    //forget matches in lines that got dropped since grep, ones in lines that
+    //went cold are still fine to jump to
+    std::size_t kept = 0u;
+    std::size_t cur = m_curmatch;
+    for(std::size_t i = 0u; i < m_matches.size(); ++i)
+    {
+        if(isMatchGone(m_matches[i]))
+        {
+            if(i < m_curmatch)
+                --cur;
+
+            continue;
+        }
+        m_matches[kept++] = m_matches[i];
+    }
+
+    m_matches.resize(kept);
+    m_curmatch = cur;
+    if(m_matches.empty())
+        return;
+
+    const int count = m_matches.size();
+    m_curmatch = ((static_cast<int>(m_curmatch) + change) % count + count) % count;
+    showCurrentMatch();
+}
+
+void LuaConsoleModel::showCurrentMatch()
+{
+    if(m_curmatch >= m_matches.size() || isMatchGone(m_matches[m_curmatch]))
+        return;
+
+    //put the line in the middle of the screen, scrollLines clips it as needed
+    const priv::ScrollbackMatch& match = m_matches[m_curmatch];
+    const int index = match.Archived?match.Line:match.Line - m_cold->getBegin() + getArchivedLineCount();
+    m_firstmsg = index - static_cast<int>(getWideLineCount()) + 11;
+    scrollLines(0);
 }
 
 void LuaConsoleModel::ensureCurInView()
@@ -927,3 +3336,20 @@ void LuaConsoleModel::ensureCurInView()
 }
 
 } //blua
+
+//console is payload of our pointer userdata, so it's null once we are gone
+extern "C" void blua_echo(void * console, const char * str, std::size_t len, unsigned color)
+{
+    blua::LuaConsoleModel * m = console?*static_cast<blua::LuaConsoleModel**>(console):0x0;
+    if(m)
+        m->echoColored(str, len, color);
+}
+
+extern "C" unsigned blua_getcolor(void * console, int which)
+{
+    blua::LuaConsoleModel * m = console?*static_cast<blua::LuaConsoleModel**>(console):0x0;
+    if(!m || which < 0 || which >= blua::ECONSOLE_COLOR_COUNT)
+        return 0u;
+
+    return m->getColor(static_cast<blua::ECONSOLE_COLOR>(which));
+}
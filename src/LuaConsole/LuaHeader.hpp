@@ -49,6 +49,8 @@ inline int bla_lua_equal(lua_State * L, int index1, int index2)
 
 #define BLA_LUA_OK LUA_OK
 
+#define bla_lua_gcisrunning(L) (lua_gc((L), LUA_GCISRUNNING, 0))
+
 #endif //LUA 5.2 or LUA 5.3
 
 //----------------------------------------------------------------------
@@ -72,6 +74,9 @@ inline bool incompleteChunkError(const char * err, std::size_t len)
 //LUA_OK is missing but 0 is assumed to be 'success' value in comments, so:
 #define BLA_LUA_OK 0
 
+//5.1 can't tell if collector was stopped so assume it's running, as by default
+#define bla_lua_gcisrunning(L) (1)
+
 #endif //LUA 5.1
 
 #endif  /* LUAHEADER_HPP */
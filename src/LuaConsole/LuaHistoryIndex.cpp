@@ -0,0 +1,210 @@
+#include <LuaConsole/LuaHistoryIndex.hpp>
+#include <algorithm>
+
+namespace blua {
+namespace priv {
+
+//pack 3 chars starting at str into a single key
+inline static unsigned makeTrigram(const char * str)
+{
+    return (static_cast<unsigned char>(str[0]) << 16) |
+            (static_cast<unsigned char>(str[1]) << 8) |
+            static_cast<unsigned char>(str[2]);
+}
+
+//pack 2 chars starting at str into a single key, with a bit set above all
+//trigram bits so bigrams and trigrams never share a key
+inline static unsigned makeBigram(const char * str)
+{
+    return 0x1000000u | (static_cast<unsigned char>(str[0]) << 8) |
+            static_cast<unsigned char>(str[1]);
+}
+
+//make key of a single char, with a bit set above all bigram bits
+inline static unsigned makeUnigram(const char * str)
+{
+    return 0x2000000u | static_cast<unsigned char>(str[0]);
+}
+
+//fill grams with sorted, unique trigrams of str, and with bigrams and
+//unigrams too if asked
+static void collectGrams(const std::string& str, std::vector<unsigned>& grams, bool shortgrams)
+{
+    grams.clear();
+    for(std::size_t i = 0u; i + 3u <= str.size(); ++i)
+        grams.push_back(makeTrigram(str.c_str() + i));
+
+    for(std::size_t i = 0u; shortgrams && i + 2u <= str.size(); ++i)
+        grams.push_back(makeBigram(str.c_str() + i));
+
+    for(std::size_t i = 0u; shortgrams && i < str.size(); ++i)
+        grams.push_back(makeUnigram(str.c_str() + i));
+
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+}
+
+HistoryIndex::HistoryIndex() { }
+
+void HistoryIndex::add(std::size_t seq, const std::string& item)
+{
+    collectGrams(item, m_grams, true);
+    for(std::size_t i = 0u; i < m_grams.size(); ++i)
+        m_postings[m_grams[i]].push_back(seq);
+}
+
+void HistoryIndex::clear()
+{
+    m_postings.clear();
+}
+
+void HistoryIndex::prune(std::size_t oldest)
+{
+    PostingsMap::iterator it = m_postings.begin();
+    while(it != m_postings.end())
+    {
+        Postings& p = it->second;
+        p.erase(p.begin(), std::lower_bound(p.begin(), p.end(), oldest));
+        if(p.empty())
+            m_postings.erase(it++);
+        else
+            ++it;
+    }
+}
+
+//comparator to order posting lists from shortest to longest
+static bool shorterPostings(const std::vector<std::size_t> * a, const std::vector<std::size_t> * b)
+{
+    return a->size() < b->size();
+}
+
+std::size_t HistoryIndex::findNewest(const std::string& query, std::size_t oldest, std::size_t before,
+                                     const std::string * skip, HistoryItemFunc getitem, void * data) const
+{
+    //empty query matches every item so scanning back finds one right away
+    if(query.empty())
+    {
+        for(std::size_t seq = before; seq > oldest; --seq)
+        {
+            const std::string& item = getitem(seq - 1u, data);
+            if(item.find(query) != std::string::npos && (!skip || item != *skip))
+                return seq - 1u;
+        }
+        return before;
+    }
+
+    //one char is a unigram, two are a bigram, longer queries are looked up
+    //by trigrams alone
+    std::vector<unsigned> grams;
+    if(query.size() == 1u)
+        grams.push_back(makeUnigram(query.c_str()));
+    else if(query.size() == 2u)
+        grams.push_back(makeBigram(query.c_str()));
+    else
+        collectGrams(query, grams, false);
+
+    //any gram that no item has means no item can match at all
+    std::vector<const Postings*> lists;
+    for(std::size_t i = 0u; i < grams.size(); ++i)
+    {
+        PostingsMap::const_iterator it = m_postings.find(grams[i]);
+        if(it == m_postings.end())
+            return before;
+
+        lists.push_back(&it->second);
+    }
+
+    //walk the rarest list from newest to oldest, check the rest by binary search
+    std::sort(lists.begin(), lists.end(), shorterPostings);
+    const Postings& rarest = *lists[0];
+    Postings::const_iterator it = std::lower_bound(rarest.begin(), rarest.end(), before);
+    while(it != rarest.begin())
+    {
+        const std::size_t seq = *--it;
+        if(seq < oldest)
+            break;
+
+        bool inall = true;
+        for(std::size_t i = 1u; i < lists.size() && inall; ++i)
+            inall = std::binary_search(lists[i]->begin(), lists[i]->end(), seq);
+
+        if(!inall)
+            continue;
+
+        //having all trigrams doesn't mean having them in the right order
+        const std::string& item = getitem(seq, data);
+        if(item.find(query) != std::string::npos && (!skip || item != *skip))
+            return seq;
+    }
+    return before;
+}
+
+HistoryTrie::HistoryTrie()
+{
+    clear();
+}
+
+void HistoryTrie::add(std::size_t seq, const std::string& item)
+{
+    unsigned node = 0u;
+    for(std::size_t i = 0u; i < item.size(); ++i)
+    {
+        //item goes on past this node since there is at least one char left
+        m_nodes[node].Longer = seq;
+
+        unsigned child = findChild(node, item[i]);
+        if(!child)
+        {
+            Node n;
+            n.Longer = 0u;
+            n.Child = 0u;
+            n.Sibling = m_nodes[node].Child;
+            n.Char = item[i];
+            child = m_nodes.size();
+            m_nodes[node].Child = child;
+            m_nodes.push_back(n);
+        }
+        node = child;
+    }
+}
+
+void HistoryTrie::clear()
+{
+    Node root;
+    root.Longer = 0u;
+    root.Child = 0u;
+    root.Sibling = 0u;
+    root.Char = '\0';
+
+    m_nodes.clear();
+    m_nodes.push_back(root);
+}
+
+std::size_t HistoryTrie::findNewest(const std::string& prefix, std::size_t none) const
+{
+    unsigned node = 0u;
+    for(std::size_t i = 0u; i < prefix.size(); ++i)
+    {
+        node = findChild(node, prefix[i]);
+        if(!node)
+            return none;
+    }
+
+    //Longer is only set once a node gets a child, so no child means no item
+    if(!m_nodes[node].Child)
+        return none;
+
+    return m_nodes[node].Longer;
+}
+
+unsigned HistoryTrie::findChild(unsigned node, char c) const
+{
+    for(unsigned child = m_nodes[node].Child; child; child = m_nodes[child].Sibling)
+        if(m_nodes[child].Char == c)
+            return child;
+
+    return 0u;
+}
+
+} //priv
+} //blua
@@ -0,0 +1,89 @@
+#ifndef LUAHISTORYINDEX_HPP
+#define	LUAHISTORYINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace blua {
+namespace priv {
+
+//returns the history item with given sequence number, data is passed along untouched
+typedef const std::string& (*HistoryItemFunc)(std::size_t seq, void * data);
+
+//unigram, bigram and trigram inverted index over history items, each item is
+//identified by its' sequence number (how many items were added before it) so
+//indices stay valid while the ring buffer of history wraps around, postings of
+//items that fell out of history are skipped when searching and dropped in prune
+
+class HistoryIndex
+{
+public:
+    HistoryIndex();
+
+    //index item that got sequence number seq, seqs must be added in increasing order
+    void add(std::size_t seq, const std::string& item);
+
+    //forget everything
+    void clear();
+
+    //drop postings of items older than oldest, call this now and then
+    void prune(std::size_t oldest);
+
+    //get sequence number of the newest item in [oldest, before) that contains
+    //query and is not equal to skip (if skip is not null), returns before if
+    //nothing was found, getitem is used to fetch items to verify candidates
+    std::size_t findNewest(const std::string& query, std::size_t oldest, std::size_t before,
+                           const std::string * skip, HistoryItemFunc getitem, void * data) const;
+
+private:
+    typedef std::vector<std::size_t> Postings;
+    typedef std::map<unsigned, Postings> PostingsMap;
+
+    PostingsMap m_postings; //gram -> ascending sequence numbers of items with it
+    std::vector<unsigned> m_grams; //reused buffer for grams of a single string
+
+};
+
+//prefix trie over history items, each node remembers the newest sequence
+//number of items that go on past it, so the newest item that extends a given
+//prefix is found in one walk down the prefix, since the remembered item is the
+//newest one, if it fell out of history then all others under that node did too
+
+class HistoryTrie
+{
+public:
+    HistoryTrie();
+
+    //add item that got sequence number seq, seqs must be added in increasing order
+    void add(std::size_t seq, const std::string& item);
+
+    //forget everything
+    void clear();
+
+    //get sequence number of the newest item that is longer than and starts
+    //with prefix, returns none if there is no such item
+    std::size_t findNewest(const std::string& prefix, std::size_t none) const;
+
+private:
+    class Node
+    {
+    public:
+        std::size_t Longer; //newest seq of items going on past this node
+        unsigned Child; //first child, 0 if none (root is never a child)
+        unsigned Sibling; //next sibling, 0 if none
+        char Char; //char that leads to this node from its' parent
+
+    };
+
+    unsigned findChild(unsigned node, char c) const;
+
+    std::vector<Node> m_nodes; //all nodes, root is at 0
+
+};
+
+} //priv
+} //blua
+
+#endif	/* LUAHISTORYINDEX_HPP */
+
@@ -0,0 +1,423 @@
+#include <LuaConsole/LuaHistoryJournal.hpp>
+
+#include <cstring>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#endif
+
+namespace blua {
+namespace priv {
+
+//first line of a compacted file, followed by length of the tail it kept, it's
+//a lua comment so it does no harm if it ever ends up being run
+const char * const kCompactHeader = "--luaconsole history journal, compacted tail bytes: ";
+
+bool isJournalHeader(const char * line, std::size_t len)
+{
+    const std::size_t headerlen = std::strlen(kCompactHeader);
+    return len >= headerlen && std::memcmp(line, kCompactHeader, headerlen) == 0;
+}
+
+#ifdef _WIN32
+
+HistoryJournal::HistoryJournal() { }
+
+HistoryJournal::~HistoryJournal() { }
+
+bool HistoryJournal::open(const std::string&, std::size_t)
+{
+    return false;
+}
+
+void HistoryJournal::close() { }
+
+bool HistoryJournal::isOpen() const
+{
+    return false;
+}
+
+void HistoryJournal::append(const std::string&) { }
+
+void HistoryJournal::setKeepLines(std::size_t) { }
+
+void HistoryJournal::takeIncoming(std::vector<std::string>&) { }
+
+#else //_WIN32
+
+//how often to look for lines of other processes when we have none to write
+const long kPollIntervalSeconds = 1;
+
+//open journal file for appending and reading, creating it if needed
+static int openJournalFile(const std::string& filename)
+{
+    return ::open(filename.c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+}
+
+static off_t getFileSize(int fd)
+{
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+        return 0;
+
+    return st.st_size;
+}
+
+//read exactly size bytes at offset into buff, returns false on any error
+static bool readAll(int fd, char * buff, std::size_t size, off_t offset)
+{
+    while(size > 0u)
+    {
+        const ssize_t got = pread(fd, buff, size, offset);
+        if(got < 0 && errno == EINTR)
+            continue;
+
+        if(got <= 0)
+            return false;
+
+        buff += got;
+        size -= got;
+        offset += got;
+    }
+    return true;
+}
+
+//get offset right after the tail a compaction kept, that's where lines
+//appended after it start, or 0 if file wasn't made by compaction
+static off_t getCompactedTailEnd(int fd)
+{
+    char buff[128];
+    const ssize_t got = pread(fd, buff, sizeof(buff) - 1u, 0);
+    if(got <= 0 || !isJournalHeader(buff, got))
+        return 0;
+
+    buff[got] = '\0';
+    const char * newline = std::strchr(buff, '\n');
+    if(!newline)
+        return 0;
+
+    const off_t tail = std::strtoul(buff + std::strlen(kCompactHeader), 0x0, 10);
+    return (newline - buff) + 1 + tail;
+}
+
+//write all size bytes from buff, returns false on any error
+static bool writeAll(int fd, const char * buff, std::size_t size)
+{
+    while(size > 0u)
+    {
+        const ssize_t put = write(fd, buff, size);
+        if(put < 0 && errno == EINTR)
+            continue;
+
+        if(put <= 0)
+            return false;
+
+        buff += put;
+        size -= put;
+    }
+    return true;
+}
+
+HistoryJournal::HistoryJournal() :
+m_open(false),
+m_fd(-1),
+m_readoff(0),
+m_sincecompact(0u),
+m_stop(false),
+m_keeplines(0u)
+{
+    pthread_mutex_init(&m_mutex, 0x0);
+    pthread_cond_init(&m_cond, 0x0);
+}
+
+HistoryJournal::~HistoryJournal()
+{
+    close();
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+bool HistoryJournal::open(const std::string& filename, std::size_t keeplines)
+{
+    close();
+
+    m_fd = openJournalFile(filename);
+    if(m_fd < 0)
+        return false;
+
+    m_filename = filename;
+    m_readoff = getFileSize(m_fd);
+    m_sincecompact = keeplines; //so first write checks if file needs compacting
+    m_keeplines = keeplines;
+    m_stop = false;
+
+    if(pthread_create(&m_thread, 0x0, &HistoryJournal::threadMain, this) != 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_open = true;
+    return true;
+}
+
+void HistoryJournal::close()
+{
+    if(!m_open)
+        return;
+
+    pthread_mutex_lock(&m_mutex);
+    m_stop = true;
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+
+    //thread writes all that is still queued before exiting
+    pthread_join(m_thread, 0x0);
+    ::close(m_fd);
+    m_fd = -1;
+    m_open = false;
+}
+
+bool HistoryJournal::isOpen() const
+{
+    return m_open;
+}
+
+void HistoryJournal::append(const std::string& line)
+{
+    if(!m_open)
+        return;
+
+    pthread_mutex_lock(&m_mutex);
+    m_outgoing.push_back(line);
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void HistoryJournal::setKeepLines(std::size_t keeplines)
+{
+    pthread_mutex_lock(&m_mutex);
+    m_keeplines = keeplines;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void HistoryJournal::takeIncoming(std::vector<std::string>& lines)
+{
+    pthread_mutex_lock(&m_mutex);
+    lines.insert(lines.end(), m_incoming.begin(), m_incoming.end());
+    m_incoming.clear();
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void * HistoryJournal::threadMain(void * data)
+{
+    static_cast<HistoryJournal*>(data)->run();
+    return 0x0;
+}
+
+void HistoryJournal::run()
+{
+    pthread_mutex_lock(&m_mutex);
+    while(true)
+    {
+        if(m_outgoing.empty() && !m_stop)
+        {
+            struct timeval now;
+            gettimeofday(&now, 0x0);
+            struct timespec until;
+            until.tv_sec = now.tv_sec + kPollIntervalSeconds;
+            until.tv_nsec = now.tv_usec * 1000;
+            pthread_cond_timedwait(&m_cond, &m_mutex, &until);
+        }
+
+        std::vector<std::string> out;
+        out.swap(m_outgoing);
+        const bool stop = m_stop;
+        const std::size_t keeplines = m_keeplines;
+        pthread_mutex_unlock(&m_mutex);
+
+        //do all file work without holding the mutex so owner never waits on disk
+        //shared lock is enough to just read, writing needs exclusive one
+        std::vector<std::string> in;
+        if(lockFile(out.empty()?LOCK_SH:LOCK_EX, in))
+        {
+            readForeign(in);
+            if(!out.empty() && writeOwn(out))
+            {
+                m_sincecompact += out.size();
+                if(keeplines != 0u && m_sincecompact >= keeplines)
+                {
+                    m_sincecompact = 0u;
+                    compact();
+                }
+            }
+            flock(m_fd, LOCK_UN);
+        }
+
+        pthread_mutex_lock(&m_mutex);
+        m_incoming.insert(m_incoming.end(), in.begin(), in.end());
+        if(stop)
+            break;
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+bool HistoryJournal::lockFile(int operation, std::vector<std::string>& lines)
+{
+    bool reopened = false;
+    while(true)
+    {
+        if(flock(m_fd, operation) != 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        //if the name still points at our file then we are good to go, if we
+        //just switched to it then we hold its' lock now, so nothing can be
+        //appended while we find where the tail the compaction kept ends, all
+        //lines before that are ones we already read from the old file
+        struct stat named, ours;
+        if(stat(m_filename.c_str(), &named) == 0 && fstat(m_fd, &ours) == 0 &&
+           named.st_dev == ours.st_dev && named.st_ino == ours.st_ino)
+        {
+            if(reopened)
+                m_readoff = getCompactedTailEnd(m_fd);
+
+            return true;
+        }
+
+        //another process compacted (or someone removed) the file, it had all
+        //lines written before that so finish reading them from the old file
+        readForeign(lines);
+        flock(m_fd, LOCK_UN);
+        const int fd = openJournalFile(m_filename);
+        if(fd < 0)
+            return false;
+
+        ::close(m_fd);
+        m_fd = fd;
+        reopened = true;
+    }
+}
+
+void HistoryJournal::readForeign(std::vector<std::string>& lines)
+{
+    const off_t size = getFileSize(m_fd);
+    if(size < m_readoff)
+        m_readoff = size; //truncated by someone, just go on from the end
+
+    if(size == m_readoff)
+        return;
+
+    std::string buff(size - m_readoff, '\0');
+    if(!readAll(m_fd, &buff[0], buff.size(), m_readoff))
+        return;
+
+    //only take complete lines, a partial one is still being written
+    std::size_t start = 0u;
+    for(std::size_t i = 0u; i < buff.size(); ++i)
+    {
+        if(buff[i] == '\n')
+        {
+            lines.push_back(buff.substr(start, i - start));
+            start = i + 1u;
+        }
+    }
+    m_readoff += start;
+}
+
+bool HistoryJournal::writeOwn(const std::vector<std::string>& lines)
+{
+    //whatever is past m_readoff now is a line a crashed writer left unfinished,
+    //end it so our first line doesn't get glued onto it
+    std::string buff;
+    if(getFileSize(m_fd) != m_readoff)
+        buff += '\n';
+
+    for(std::size_t i = 0u; i < lines.size(); ++i)
+    {
+        buff += lines[i];
+        buff += '\n';
+    }
+
+    //we hold exclusive lock so all after m_readoff is our own, don't read it back
+    const bool ok = writeAll(m_fd, buff.data(), buff.size());
+    m_readoff = getFileSize(m_fd);
+    return ok;
+}
+
+void HistoryJournal::compact()
+{
+    pthread_mutex_lock(&m_mutex);
+    const std::size_t keeplines = m_keeplines;
+    pthread_mutex_unlock(&m_mutex);
+
+    const off_t size = getFileSize(m_fd);
+    std::string buff(size, '\0');
+    if(size == 0 || !readAll(m_fd, &buff[0], buff.size(), 0))
+        return;
+
+    //find where last keeplines lines start, but only bother if there are over
+    //twice as many lines, so compaction is rare and amortized over many writes
+    std::size_t newlines = 0u;
+    std::size_t keepstart = 0u;
+    for(std::size_t i = buff.size(); i > 0u; --i)
+    {
+        if(buff[i - 1u] != '\n')
+            continue;
+
+        ++newlines;
+        if(newlines == keeplines + 1u)
+            keepstart = i;
+
+        if(newlines > 2u * keeplines)
+            break;
+    }
+
+    if(newlines <= 2u * keeplines)
+        return;
+
+    //write header with tail length and tail to a temp file and rename it
+    //over, so at any point the file on disk is either the old one or the
+    //complete new one, it's locked before rename so no one can append to it
+    //until we're done and the lock goes with the descriptor that we keep
+    char pid[32];
+    std::sprintf(pid, ".tmp.%ld", static_cast<long>(getpid()));
+    const std::string tmpname = m_filename + pid;
+    const int tmp = ::open(tmpname.c_str(), O_RDWR | O_APPEND | O_CREAT | O_TRUNC, 0644);
+    if(tmp < 0)
+        return;
+
+    char header[128];
+    const std::size_t taillen = buff.size() - keepstart;
+    const int headerlen = std::sprintf(header, "%s%lu\n", kCompactHeader, static_cast<unsigned long>(taillen));
+    const bool ok = flock(tmp, LOCK_EX) == 0 && writeAll(tmp, header, headerlen) &&
+            writeAll(tmp, buff.data() + keepstart, taillen) && fsync(tmp) == 0;
+
+    if(!ok || rename(tmpname.c_str(), m_filename.c_str()) != 0)
+    {
+        ::close(tmp);
+        unlink(tmpname.c_str());
+        return;
+    }
+
+    ::close(m_fd);
+    m_fd = tmp;
+    m_readoff = getFileSize(m_fd);
+}
+
+#endif //_WIN32
+
+} //priv
+} //blua
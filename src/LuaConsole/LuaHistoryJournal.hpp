@@ -0,0 +1,91 @@
+#ifndef LUAHISTORYJOURNAL_HPP
+#define	LUAHISTORYJOURNAL_HPP
+
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sys/types.h>
+#endif
+
+namespace blua {
+namespace priv {
+
+//check if line is the header a compacted journal file starts with, history
+//loading skips it
+bool isJournalHeader(const char * line, std::size_t len);
+
+//append only history file shared by any number of processes, lines are handed
+//to a background thread that appends them with O_APPEND under an exclusive
+//flock, so a crash loses at most the lines that were still queued and no
+//process ever overwrites what another one wrote, the same thread picks up lines
+//appended by other processes (polling once a second and on each write) and
+//now and then compacts the file to the last keeplines lines via a temp file
+//and rename, so the file on disk is never in a half written state, the new
+//file starts with a header line that says how long the kept tail is, so other
+//processes that switch to it know where lines appended after it begin
+//
+//this is POSIX only, on Windows open always fails and nothing else happens
+
+class HistoryJournal
+{
+public:
+    HistoryJournal();
+
+    //closes, see close
+    ~HistoryJournal();
+
+    //start journaling to filename, closing the previous file if any, lines
+    //already in the file are not read, use normal history loading for them
+    bool open(const std::string& filename, std::size_t keeplines);
+
+    //write out all queued lines and stop the background thread
+    void close();
+
+    //check if a file is open
+    bool isOpen() const;
+
+    //queue line to be appended to the file
+    void append(const std::string& line);
+
+    //set how many last lines compaction keeps
+    void setKeepLines(std::size_t keeplines);
+
+    //move lines other processes appended since last call to the end of lines
+    void takeIncoming(std::vector<std::string>& lines);
+
+private:
+    //delete copy and assignment to forbid copying (thread has our 'this')
+    HistoryJournal(const HistoryJournal& other);
+    HistoryJournal& operator=(const HistoryJournal& other);
+
+#ifndef _WIN32
+    static void * threadMain(void * data);
+    void run();
+    bool lockFile(int operation, std::vector<std::string>& lines);
+    void readForeign(std::vector<std::string>& lines);
+    bool writeOwn(const std::vector<std::string>& lines);
+    void compact();
+
+    bool m_open; //is the journal open, only touched by our owner's thread
+    std::string m_filename; //name of the journal file
+    int m_fd; //descriptor of journal file, only touched by writer thread when open
+    off_t m_readoff; //how far into file we already read (or wrote) lines
+    std::size_t m_sincecompact; //own lines written since last compaction check
+    pthread_t m_thread; //the writer thread
+    pthread_mutex_t m_mutex; //guards everything below
+    pthread_cond_t m_cond; //signaled on new lines or stop
+    bool m_stop; //should the thread exit
+    std::size_t m_keeplines; //how many lines compaction keeps
+    std::vector<std::string> m_outgoing; //lines to append to file
+    std::vector<std::string> m_incoming; //lines other processes appended
+#endif
+
+};
+
+} //priv
+} //blua
+
+#endif	/* LUAHISTORYJOURNAL_HPP */
+
@@ -0,0 +1,219 @@
+#include <LuaConsole/LuaInspector.hpp>
+#include <LuaConsole/LuaPrettyPrint.hpp>
+#include <LuaConsole/LuaHeader.hpp>
+#include <algorithm>
+#include <cstdio>
+
+namespace blua {
+namespace priv {
+
+//how many entries one page lists
+const int kInspectPageSize = 50;
+
+//how many tables are inspected at once at most, oldest are dropped past it
+const std::size_t kMaxInspectNodes = 4096u;
+
+//how many bytes of a single row are printed at most
+const std::size_t kMaxRowBytes = 256u;
+
+//in protected mode, since next raises an error if key is no longer in table,
+//takes table, key and count, returns up to count pairs of key and value that
+//follow key and then a boolean telling if there are more
+static int nextEntries(lua_State * L)
+{
+    const int count = static_cast<int>(lua_tointeger(L, 3));
+    lua_settop(L, 2);
+    if(!lua_checkstack(L, 2 * count + 3))
+        return luaL_error(L, "stack overflow");
+
+    lua_pushvalue(L, 2);
+    int got = 0;
+    while(got < count && lua_next(L, 1))
+    {
+        lua_pushvalue(L, -2); //copy of key for next call, originals stay as results
+        ++got;
+    }
+
+    //if we got all, peek with the last key copy to see if there are more
+    bool more = false;
+    if(got == count)
+    {
+        more = lua_next(L, 1) != 0;
+        if(more)
+            lua_pop(L, 2);
+    }
+
+    lua_pushboolean(L, more);
+    return lua_gettop(L) - 2;
+}
+
+static void appendRow(const std::string& line, void * data)
+{
+    static_cast<std::vector<std::string>*>(data)->push_back(line);
+}
+
+Inspector::Inspector() :
+m_nextid(1u) { }
+
+unsigned Inspector::add(lua_State * L, int index)
+{
+    char buff[64];
+    std::sprintf(buff, "table: %p", lua_topointer(L, index));
+    return addNode(L, index, 0u, buff);
+}
+
+bool Inspector::has(unsigned id) const
+{
+    return m_nodes.find(id) != m_nodes.end();
+}
+
+bool Inspector::page(lua_State * L, unsigned id, bool restart, std::vector<std::string>& rows)
+{
+    NodeMap::iterator it = m_nodes.find(id);
+    if(it == m_nodes.end())
+        return false;
+
+    if(restart)
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, it->second.KeyRef);
+        it->second.KeyRef = LUA_NOREF;
+        it->second.Shown = 0u;
+    }
+
+    const int oldtop = lua_gettop(L);
+    lua_pushcfunction(L, &nextEntries);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, it->second.Ref);
+    if(it->second.KeyRef == LUA_NOREF)
+        lua_pushnil(L);
+    else
+        lua_rawgeti(L, LUA_REGISTRYINDEX, it->second.KeyRef);
+
+    lua_pushinteger(L, kInspectPageSize);
+    if(BLA_LUA_OK != lua_pcall(L, 3, LUA_MULTRET, 0))
+    {
+        lua_settop(L, oldtop);
+        return false;
+    }
+
+    const int first = oldtop + 1;
+    const int pairs = (lua_gettop(L) - first) / 2;
+    const bool more = lua_toboolean(L, -1);
+
+    //adding nodes below might drop old ones, including this one, so copy what's needed
+    const std::string parentpath = it->second.Path;
+    const std::size_t shown = it->second.Shown;
+
+    char buff[128];
+    std::sprintf(buff, "[%u] ", id);
+    std::string header = buff + parentpath;
+    std::sprintf(buff, ", entries %lu to %lu:", static_cast<unsigned long>(shown + 1u),
+                 static_cast<unsigned long>(shown + pairs));
+    header += (pairs == 0)?", empty":buff;
+    rows.push_back(header);
+
+    //ids of tables found now are only known after adding them, so first print
+    //entry into row, then prefix it with id (or with spaces)
+    for(int i = 0; i < pairs; ++i)
+    {
+        const int key = first + 2 * i;
+        const int value = key + 1;
+        std::vector<std::string> entry;
+        PrettyPrinter printer(L, &appendRow, &entry, 0u, 0u, kMaxRowBytes);
+        printer.printEntry(key, value);
+        printer.finish();
+
+        std::string row = entry.empty()?std::string():entry[0];
+        if(lua_type(L, value) == LUA_TTABLE)
+        {
+            const std::string keytext = row.substr(0u, row.find(" = "));
+            const std::string path = parentpath + ((!keytext.empty() && keytext[0] == '[')?"":".") + keytext;
+            std::sprintf(buff, "  [%u] ", addNode(L, value, id, path));
+            rows.push_back(buff + row);
+        }
+        else
+        {
+            rows.push_back("  " + row);
+        }
+    }
+
+    it = m_nodes.find(id);
+    if(it != m_nodes.end())
+    {
+        it->second.Shown += pairs;
+        luaL_unref(L, LUA_REGISTRYINDEX, it->second.KeyRef);
+        it->second.KeyRef = LUA_NOREF;
+        if(more && pairs > 0)
+        {
+            lua_pushvalue(L, first + 2 * (pairs - 1));
+            it->second.KeyRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+    }
+
+    if(more)
+    {
+        std::sprintf(buff, "  --more %u for next page, --open N to open a table", id);
+        rows.push_back(buff);
+    }
+
+    lua_settop(L, oldtop);
+    return true;
+}
+
+void Inspector::close(lua_State * L, unsigned id)
+{
+    //children always have bigger ids than parents, so one pass in order
+    //finds all descendants, their' parents are found before them
+    std::vector<unsigned> closed(1u, id);
+    NodeMap::iterator it = m_nodes.lower_bound(id);
+    while(it != m_nodes.end())
+    {
+        const bool descendant = it->first == id ||
+                std::find(closed.begin(), closed.end(), it->second.Parent) != closed.end();
+
+        if(!descendant)
+        {
+            ++it;
+            continue;
+        }
+
+        closed.push_back(it->first);
+        release(L, it->second);
+        m_nodes.erase(it++);
+    }
+}
+
+void Inspector::clear(lua_State * L)
+{
+    for(NodeMap::iterator it = m_nodes.begin(); it != m_nodes.end(); ++it)
+        release(L, it->second);
+
+    m_nodes.clear();
+}
+
+unsigned Inspector::addNode(lua_State * L, int index, unsigned parent, const std::string& path)
+{
+    if(m_nodes.size() >= kMaxInspectNodes)
+    {
+        release(L, m_nodes.begin()->second);
+        m_nodes.erase(m_nodes.begin());
+    }
+
+    Node node;
+    lua_pushvalue(L, index);
+    node.Ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    node.KeyRef = LUA_NOREF;
+    node.Parent = parent;
+    node.Path = path;
+    node.Shown = 0u;
+    m_nodes[m_nextid] = node;
+    return m_nextid++;
+}
+
+void Inspector::release(lua_State * L, const Node& node)
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, node.Ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, node.KeyRef);
+}
+
+} //priv
+} //blua
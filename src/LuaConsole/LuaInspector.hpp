@@ -0,0 +1,69 @@
+#ifndef LUAINSPECTOR_HPP
+#define	LUAINSPECTOR_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+struct lua_State;
+
+namespace blua {
+namespace priv {
+
+//tables being inspected, each one is kept alive by a registry reference and
+//has an id that user opens it by, opening lists one page of its' entries,
+//one row per entry, and rows of entries that are tables get ids of their' own
+//to be opened later, paging goes on from the last key of previous page (also
+//kept by a reference) so a page costs the same no matter how big the table is
+//and nothing is ever done for tables that are not open
+
+class Inspector
+{
+public:
+    Inspector();
+
+    //start inspecting table at index, returns its' id
+    unsigned add(lua_State * L, int index);
+
+    //check whether or not there is a table with given id
+    bool has(unsigned id) const;
+
+    //append header and rows of next page of entries of table with given id to
+    //rows, or of first page if restart is true, returns false if there is
+    //no such table or next raised an error (because the key of last page
+    //was removed from table since then, restart paging then)
+    bool page(lua_State * L, unsigned id, bool restart, std::vector<std::string>& rows);
+
+    //stop inspecting table with given id and all tables inside it
+    void close(lua_State * L, unsigned id);
+
+    //stop inspecting all tables
+    void clear(lua_State * L);
+
+private:
+    class Node
+    {
+    public:
+        int Ref; //reference of the table
+        int KeyRef; //reference of last key of last page, LUA_NOREF at start
+        unsigned Parent; //id of table this one was found in, 0 if none
+        std::string Path; //how to get to this table from the root one
+        std::size_t Shown; //how many entries were listed already
+
+    };
+
+    typedef std::map<unsigned, Node> NodeMap;
+
+    unsigned addNode(lua_State * L, int index, unsigned parent, const std::string& path);
+    void release(lua_State * L, const Node& node);
+
+    NodeMap m_nodes; //all tables we inspect, by id
+    unsigned m_nextid; //id the next table gets
+
+};
+
+} //priv
+} //blua
+
+#endif	/* LUAINSPECTOR_HPP */
+
@@ -0,0 +1,336 @@
+#include <LuaConsole/LuaOutputCapture.hpp>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#endif
+
+namespace blua {
+namespace priv {
+
+#ifdef _WIN32
+
+OutputCapture::OutputCapture() { }
+
+OutputCapture::~OutputCapture() { }
+
+bool OutputCapture::open(bool, bool, bool)
+{
+    return false;
+}
+
+void OutputCapture::close() { }
+
+bool OutputCapture::isOpen() const
+{
+    return false;
+}
+
+const CapturedLines& OutputCapture::take(std::size_t& dropped)
+{
+    dropped = 0u;
+    return m_taken;
+}
+
+#else //_WIN32
+
+//how big we ask the pipes to be, Linux lets anyone go up to 1MB by default
+const int kPipeSize = 1024 * 1024;
+
+//how much is read from a pipe at once
+const std::size_t kReadSize = 64u * 1024u;
+
+//line without a newline this long is queued as it is
+const std::size_t kMaxLineSize = 64u * 1024u;
+
+//past this many bytes queued new lines are dropped instead
+const std::size_t kMaxQueuedSize = 1024u * 1024u;
+
+//write all size bytes from buff, returns false on any error
+static bool writeAll(int fd, const char * buff, std::size_t size)
+{
+    while(size > 0u)
+    {
+        const ssize_t put = write(fd, buff, size);
+        if(put < 0 && errno == EINTR)
+            continue;
+
+        if(put <= 0)
+            return false;
+
+        buff += put;
+        size -= put;
+    }
+    return true;
+}
+
+//point fd at write end of a new pipe, saving a duplicate of what it was
+static bool redirectDescriptor(int fd, int& readend, int& saved)
+{
+    int ends[2];
+    if(pipe(ends) != 0)
+        return false;
+
+    saved = dup(fd);
+    if(saved < 0 || dup2(ends[1], fd) < 0)
+    {
+        if(saved >= 0)
+            ::close(saved);
+
+        ::close(ends[0]);
+        ::close(ends[1]);
+        saved = -1;
+        return false;
+    }
+
+    //fd is the only write end now, so pipe ends when fd is put back
+    ::close(ends[1]);
+
+#ifdef F_SETPIPE_SZ
+    fcntl(ends[0], F_SETPIPE_SZ, kPipeSize); //a smaller pipe still works
+#endif
+
+    fcntl(ends[0], F_SETFL, fcntl(ends[0], F_GETFL) | O_NONBLOCK);
+    fcntl(ends[0], F_SETFD, FD_CLOEXEC);
+    fcntl(saved, F_SETFD, FD_CLOEXEC);
+    readend = ends[0];
+    return true;
+}
+
+//add line to lines unless too much is queued, returns false if it was dropped
+static bool queueLine(CapturedLines& lines, const char * str, std::size_t len, bool error)
+{
+    if(len != 0u && str[len - 1u] == '\r')
+        --len;
+
+    if(lines.Text.size() + len > kMaxQueuedSize)
+        return false;
+
+    CapturedLine line;
+    line.Start = lines.Text.size();
+    line.Length = len;
+    line.Error = error;
+    lines.Text.append(str, len);
+    lines.Lines.push_back(line);
+    return true;
+}
+
+OutputCapture::OutputCapture() :
+m_open(false),
+m_tee(false),
+m_dropped(0u)
+{
+    for(int i = 0; i < 2; ++i)
+    {
+        m_read[i] = -1;
+        m_saved[i] = -1;
+        m_wake[i] = -1;
+    }
+    pthread_mutex_init(&m_mutex, 0x0);
+}
+
+OutputCapture::~OutputCapture()
+{
+    close();
+    pthread_mutex_destroy(&m_mutex);
+}
+
+bool OutputCapture::open(bool capturestdout, bool capturestderr, bool tee)
+{
+    close();
+
+    if(pipe(m_wake) != 0)
+        return false;
+
+    fcntl(m_wake[0], F_SETFD, FD_CLOEXEC);
+    fcntl(m_wake[1], F_SETFD, FD_CLOEXEC);
+
+    //what stdio buffered so far belongs to the original streams
+    std::fflush(stdout);
+    std::fflush(stderr);
+
+    const bool capture[2] = {capturestdout, capturestderr};
+    bool any = false;
+    for(int i = 0; i < 2; ++i)
+        any = (capture[i] && redirectDescriptor(i + 1, m_read[i], m_saved[i])) || any;
+
+    m_tee = tee;
+    if(!any || pthread_create(&m_thread, 0x0, &OutputCapture::threadMain, this) != 0)
+    {
+        close(); //puts back whatever did get captured
+        return false;
+    }
+
+    m_open = true;
+    return true;
+}
+
+void OutputCapture::close()
+{
+    //wake pipe is only there while open, or while open is failing
+    if(m_wake[0] < 0)
+        return;
+
+    std::fflush(stdout);
+    std::fflush(stderr);
+    for(int i = 0; i < 2; ++i)
+        if(m_saved[i] >= 0)
+            dup2(m_saved[i], i + 1);
+
+    //wake the thread, it drains what is left in the pipes and exits
+    if(m_open)
+    {
+        const char wake = '\0';
+        while(write(m_wake[1], &wake, 1u) < 0 && errno == EINTR);
+        pthread_join(m_thread, 0x0);
+    }
+
+    for(int i = 0; i < 2; ++i)
+    {
+        if(m_read[i] >= 0)
+            ::close(m_read[i]);
+
+        if(m_saved[i] >= 0)
+            ::close(m_saved[i]);
+
+        ::close(m_wake[i]);
+        m_read[i] = -1;
+        m_saved[i] = -1;
+        m_wake[i] = -1;
+    }
+    m_open = false;
+}
+
+bool OutputCapture::isOpen() const
+{
+    return m_open;
+}
+
+const CapturedLines& OutputCapture::take(std::size_t& dropped)
+{
+    //stdio might be holding a lot if stdout became fully buffered once it was a pipe
+    if(m_open && m_read[0] >= 0)
+        std::fflush(stdout);
+
+    m_taken.Text.clear();
+    m_taken.Lines.clear();
+
+    //thread gets our emptied buffers back, so neither side allocates again
+    pthread_mutex_lock(&m_mutex);
+    m_taken.Text.swap(m_queued.Text);
+    m_taken.Lines.swap(m_queued.Lines);
+    dropped = m_dropped;
+    m_dropped = 0u;
+    pthread_mutex_unlock(&m_mutex);
+    return m_taken;
+}
+
+void * OutputCapture::threadMain(void * data)
+{
+    static_cast<OutputCapture*>(data)->run();
+    return 0x0;
+}
+
+void OutputCapture::run()
+{
+    //negative descriptors are ignored by poll
+    pollfd fds[3];
+    fds[0].fd = m_wake[0];
+    fds[1].fd = m_read[0];
+    fds[2].fd = m_read[1];
+    for(int i = 0; i < 3; ++i)
+        fds[i].events = POLLIN;
+
+    bool stop = false;
+    while(!stop)
+    {
+        if(poll(fds, 3, -1) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        //on stop pipes are drained one last time, descriptors are already put back
+        stop = fds[0].revents != 0;
+        for(int i = 0; i < 2; ++i)
+            if(fds[i + 1].fd >= 0 && (fds[i + 1].revents != 0 || stop) && !drain(i))
+                fds[i + 1].fd = -1; //no writers left
+    }
+
+    //lines that never got their newline
+    for(int i = 0; i < 2; ++i)
+        queueLines(i, "", 0u, true);
+}
+
+//read all that is in pipe of stream now, returns false once it's ended
+bool OutputCapture::drain(int stream)
+{
+    char buff[kReadSize];
+    while(true)
+    {
+        const ssize_t got = read(m_read[stream], buff, sizeof(buff));
+        if(got < 0 && errno == EINTR)
+            continue;
+
+        if(got < 0)
+            return true; //EAGAIN, pipe is empty
+
+        if(got == 0)
+            return false;
+
+        if(m_tee)
+            writeAll(m_saved[stream], buff, got);
+
+        queueLines(stream, buff, got, false);
+    }
+}
+
+//queue complete lines of partial line of stream followed by buff, keeping
+//the rest as the new partial line, if last then the rest is queued too
+void OutputCapture::queueLines(int stream, const char * buff, std::size_t size, bool last)
+{
+    std::string& partial = m_partial[stream];
+    const bool error = stream == 1;
+
+    pthread_mutex_lock(&m_mutex);
+    std::size_t start = 0u;
+    for(std::size_t i = 0u; i < size; ++i)
+    {
+        if(buff[i] != '\n')
+            continue;
+
+        //almost always there is no partial line so we copy once, straight from buff
+        bool queued;
+        if(partial.empty())
+        {
+            queued = queueLine(m_queued, buff + start, i - start, error);
+        }
+        else
+        {
+            partial.append(buff + start, i - start);
+            queued = queueLine(m_queued, partial.data(), partial.size(), error);
+            partial.clear();
+        }
+
+        m_dropped += !queued;
+        start = i + 1u;
+    }
+
+    partial.append(buff + start, size - start);
+    if((last && !partial.empty()) || partial.size() >= kMaxLineSize)
+    {
+        m_dropped += !queueLine(m_queued, partial.data(), partial.size(), error);
+        partial.clear();
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+#endif //_WIN32
+
+} //priv
+} //blua
@@ -0,0 +1,103 @@
+#ifndef LUAOUTPUTCAPTURE_HPP
+#define	LUAOUTPUTCAPTURE_HPP
+
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace blua {
+namespace priv {
+
+//one line of captured output, its' chars are in Text of CapturedLines
+
+class CapturedLine
+{
+public:
+    std::size_t Start;
+    std::size_t Length;
+    bool Error; //did it come from stderr
+
+};
+
+//a batch of captured lines, all their text is in one string so a batch
+//costs no allocations once both batches grew big enough
+
+class CapturedLines
+{
+public:
+    std::string Text;
+    std::vector<CapturedLine> Lines;
+
+};
+
+//redirects file descriptors 1 and 2 (or just one of them) of the process into
+//pipes that a background thread drains as soon as anything is written, so
+//writers never wait on us, it splits what it reads into lines and queues
+//them until the owner takes a whole batch, if the owner doesn't take them for
+//long and over 1MB is queued then new lines are dropped (and counted) rather
+//than making the thread stop draining, pipes are made as big as the system
+//allows (on Linux) to take bursts, with tee each read is also written to the
+//original descriptor, that is done by the thread too so a slow terminal can
+//slow down draining, but never makes the writers wait on the console itself
+//
+//this is POSIX only, on Windows open always fails and nothing else happens
+
+class OutputCapture
+{
+public:
+    OutputCapture();
+
+    //closes, see close
+    ~OutputCapture();
+
+    //start capturing stdout and/or stderr, closing previous capture if any,
+    //returns false if neither could be captured
+    bool open(bool capturestdout, bool capturestderr, bool tee);
+
+    //put the original descriptors back and stop the thread, lines that are
+    //still queued (and partial last lines) can still be taken after this
+    void close();
+
+    //check if capture is open
+    bool isOpen() const;
+
+    //flush C stdio buffers into the pipes and take all lines queued so far,
+    //lines stay valid until next call, dropped is set to how many lines were
+    //dropped since last call because too many were queued
+    const CapturedLines& take(std::size_t& dropped);
+
+private:
+    //delete copy and assignment to forbid copying (thread has our 'this')
+    OutputCapture(const OutputCapture& other);
+    OutputCapture& operator=(const OutputCapture& other);
+
+    CapturedLines m_taken; //lines taken last time, reused by next take
+
+#ifndef _WIN32
+    static void * threadMain(void * data);
+    void run();
+    bool drain(int stream);
+    void queueLines(int stream, const char * buff, std::size_t size, bool last);
+
+    bool m_open; //is the capture open, only touched by our owner's thread
+    bool m_tee; //do we write what we read to original descriptors too
+    int m_read[2]; //read ends of pipes of stdout and stderr, -1 if not captured
+    int m_saved[2]; //duplicates of original stdout and stderr, -1 if not captured
+    int m_wake[2]; //pipe the owner writes to to wake the thread up on close
+    std::string m_partial[2]; //incomplete last lines of stdout and stderr, thread only
+    pthread_t m_thread; //the reader thread
+    pthread_mutex_t m_mutex; //guards everything below
+    CapturedLines m_queued; //lines read but not taken yet
+    std::size_t m_dropped; //lines dropped since last take
+#endif
+
+};
+
+} //priv
+} //blua
+
+#endif	/* LUAOUTPUTCAPTURE_HPP */
+
@@ -0,0 +1,337 @@
+#include <LuaConsole/LuaPrettyPrint.hpp>
+#include <LuaConsole/LuaHeader.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+
+namespace blua {
+namespace priv {
+
+//integral doubles under this print the same as %.14g would print them
+const double kPlainIntegerLimit = 1e14;
+
+//write digits of value backwards, ending at end, returns where they start
+static char * writeDigits(char * end, unsigned long value)
+{
+    do
+    {
+        *--end = static_cast<char>('0' + value % 10u);
+        value /= 10u;
+    }
+    while(value != 0u);
+    return end;
+}
+
+//format integral double with absolute value under kPlainIntegerLimit, it's
+//split in two halves of 9 digits at most, since long might be just 32 bits
+static std::size_t formatIntegral(double d, char * buff)
+{
+    const bool negative = d < 0.0;
+    const double a = negative?-d:d;
+    const unsigned long high = static_cast<unsigned long>(a / 1e9);
+    const unsigned long low = static_cast<unsigned long>(a - high * 1e9);
+
+    char tmp[kNumberBufferSize];
+    char * const end = tmp + sizeof(tmp);
+    char * start = writeDigits(end, low);
+    if(high != 0u)
+    {
+        while(end - start < 9)
+            *--start = '0';
+
+        start = writeDigits(start, high);
+    }
+
+    if(negative)
+        *--start = '-';
+
+    std::copy(start, end, buff);
+    return end - start;
+}
+
+std::size_t formatNumber(lua_State * L, int index, char * buff)
+{
+#if (LUA_VERSION_NUM >= 503)
+    if(lua_isinteger(L, index))
+    {
+        const lua_Integer i = lua_tointeger(L, index);
+        const lua_Unsigned u = (i < 0)?(0u - static_cast<lua_Unsigned>(i)):static_cast<lua_Unsigned>(i);
+        char tmp[kNumberBufferSize];
+        char * const end = tmp + sizeof(tmp);
+        char * start = end;
+        lua_Unsigned v = u;
+        do
+        {
+            *--start = static_cast<char>('0' + v % 10u);
+            v /= 10u;
+        }
+        while(v != 0u);
+
+        if(i < 0)
+            *--start = '-';
+
+        std::copy(start, end, buff);
+        return end - start;
+    }
+#endif
+
+    const double d = lua_tonumber(L, index);
+    std::size_t len;
+
+    //-0 is not fast pathed since it has to print as -0
+    if(d != 0.0 && d > -kPlainIntegerLimit && d < kPlainIntegerLimit && std::floor(d) == d)
+        len = formatIntegral(d, buff);
+    else
+        len = std::sprintf(buff, "%.14g", d);
+
+#if (LUA_VERSION_NUM >= 503)
+    //5.3 prints floats that look like integers with .0 at the end
+    bool looksintegral = true;
+    for(std::size_t i = 0u; i < len && looksintegral; ++i)
+        looksintegral = buff[i] == '-' || std::isdigit(static_cast<unsigned char>(buff[i]));
+
+    if(looksintegral)
+    {
+        buff[len++] = '.';
+        buff[len++] = '0';
+    }
+#endif
+
+    return len;
+}
+
+PrettyPrinter::PrettyPrinter(lua_State * L, PrintedLineFunc linefunc, void * data,
+                             std::size_t maxdepth, std::size_t maxitems, std::size_t maxbytes) :
+L(L),
+m_linefunc(linefunc),
+m_data(data),
+m_maxdepth(maxdepth),
+m_maxitems(maxitems),
+m_maxbytes(maxbytes),
+m_bytes(0u),
+m_full(false),
+m_indent(0u) { }
+
+void PrettyPrinter::print(int index)
+{
+    if(index < 0)
+        index = lua_gettop(L) + index + 1;
+
+    printValue(index, 0u, false);
+}
+
+void PrettyPrinter::printEntry(int key, int value)
+{
+    if(key < 0)
+        key = lua_gettop(L) + key + 1;
+
+    if(value < 0)
+        value = lua_gettop(L) + value + 1;
+
+    printKey(key);
+    put(" = ");
+    printValue(value, 0u, true);
+}
+
+void PrettyPrinter::printSeparator()
+{
+    put(" ", 1u);
+}
+
+void PrettyPrinter::finish()
+{
+    if(!m_line.empty())
+        m_linefunc(m_line, m_data);
+
+    m_line.clear();
+}
+
+void PrettyPrinter::printValue(int index, std::size_t depth, bool quote)
+{
+    char buff[kNumberBufferSize + 64u];
+    switch(lua_type(L, index))
+    {
+        case LUA_TNIL:
+            put("nil");
+            break;
+        case LUA_TBOOLEAN:
+            put(lua_toboolean(L, index)?"true":"false");
+            break;
+        case LUA_TNUMBER:
+            put(buff, formatNumber(L, index, buff));
+            break;
+        case LUA_TSTRING:
+        {
+            std::size_t len;
+            const char * str = lua_tolstring(L, index, &len);
+            //unquoted ones are only ever returned values themselves, not
+            //inside of tables, so they are printed whole like print does
+            if(quote)
+                printQuoted(str, len);
+            else
+                m_line.append(str, len);
+        }
+            break;
+        case LUA_TTABLE:
+            printTable(index, depth);
+            break;
+        default:
+            put(luaL_typename(L, index));
+            std::sprintf(buff, ": %p", lua_topointer(L, index));
+            put(buff);
+            break;
+    } //switch lua type index
+}
+
+void PrettyPrinter::printTable(int index, std::size_t depth)
+{
+    const void * table = lua_topointer(L, index);
+    if(std::find(m_path.begin(), m_path.end(), table) != m_path.end())
+        return put("<cycle>");
+
+    //key, value and a copy of a key for printing need room on the stack
+    if(depth >= m_maxdepth || !lua_checkstack(L, 3))
+        return put("{...}");
+
+    put("{");
+    m_path.push_back(table);
+    ++m_indent;
+
+    std::size_t items = 0u;
+    lua_pushnil(L);
+    while(lua_next(L, index))
+    {
+        if(m_full || items == m_maxitems)
+        {
+            lua_pop(L, 2); //pop key and value, we are done with this table
+            newLine();
+            put("...");
+            break;
+        }
+
+        //key and value are at top, with stack only growing below, so their'
+        //absolute indices stay valid while printing nested tables
+        newLine();
+        printKey(lua_gettop(L) - 1);
+        put(" = ");
+        printValue(lua_gettop(L), depth + 1u, true);
+        put(",");
+        lua_pop(L, 1); //pop value, keep key for next
+        ++items;
+    }
+
+    --m_indent;
+    m_path.pop_back();
+    if(items != 0u)
+        newLine();
+
+    put("}");
+}
+
+//lua keywords can't be used as names in tables
+static bool isKeyword(const char * str)
+{
+    static const char * const keywords[] = {
+        "and", "break", "do", "else", "elseif", "end", "false", "for",
+        "function", "goto", "if", "in", "local", "nil", "not", "or", "repeat",
+        "return", "then", "true", "until", "while", 0x0
+    };
+
+    for(int i = 0; keywords[i]; ++i)
+        if(0 == std::strcmp(keywords[i], str))
+            return true;
+
+    return false;
+}
+
+static bool isName(const char * str, std::size_t len)
+{
+    if(len == 0u || std::isdigit(static_cast<unsigned char>(str[0])))
+        return false;
+
+    for(std::size_t i = 0u; i < len; ++i)
+        if(!std::isalnum(static_cast<unsigned char>(str[i])) && str[i] != '_')
+            return false;
+
+    return !isKeyword(str);
+}
+
+void PrettyPrinter::printKey(int index)
+{
+    //don't lua_tolstring a number key, it'd turn it into string and break lua_next
+    if(lua_type(L, index) == LUA_TSTRING)
+    {
+        std::size_t len;
+        const char * str = lua_tolstring(L, index, &len);
+        if(isName(str, len))
+            return put(str, len);
+    }
+
+    put("[");
+    printValue(index, m_maxdepth, true);
+    put("]");
+}
+
+void PrettyPrinter::printQuoted(const char * str, std::size_t len)
+{
+    //escape whatever %q would, so the result can be pasted back into code
+    put("\"", 1u);
+    std::size_t start = 0u;
+    for(std::size_t i = 0u; i < len && !m_full; ++i)
+    {
+        const unsigned char c = static_cast<unsigned char>(str[i]);
+        if(c != '"' && c != '\\' && !std::iscntrl(c))
+            continue;
+
+        put(str + start, i - start);
+        char buff[8];
+        if(c == '"' || c == '\\')
+            std::sprintf(buff, "\\%c", c);
+        else if(c == '\n')
+            std::sprintf(buff, "\\n");
+        else
+            std::sprintf(buff, "\\%03u", static_cast<unsigned>(c));
+
+        put(buff);
+        start = i + 1u;
+    }
+    put(str + start, len - start);
+    put("\"", 1u);
+}
+
+void PrettyPrinter::put(const char * str, std::size_t len)
+{
+    if(m_full)
+        return;
+
+    if(len > m_maxbytes - m_bytes)
+    {
+        m_line.append(str, m_maxbytes - m_bytes);
+        m_line += "...";
+        m_bytes = m_maxbytes;
+        m_full = true;
+        return;
+    }
+
+    m_line.append(str, len);
+    m_bytes += len;
+}
+
+void PrettyPrinter::put(const char * str)
+{
+    put(str, std::strlen(str));
+}
+
+void PrettyPrinter::newLine()
+{
+    if(m_full)
+        return;
+
+    m_linefunc(m_line, m_data);
+    m_line.assign(2u * m_indent, ' ');
+}
+
+} //priv
+} //blua
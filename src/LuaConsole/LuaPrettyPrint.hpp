@@ -0,0 +1,76 @@
+#ifndef LUAPRETTYPRINT_HPP
+#define	LUAPRETTYPRINT_HPP
+
+#include <string>
+#include <vector>
+
+struct lua_State;
+
+namespace blua {
+namespace priv {
+
+//big enough for any number formatNumber makes
+const std::size_t kNumberBufferSize = 48u;
+
+//format number at index into buff the way tostring does it, without
+//allocating and without converting the value on the stack like lua_tostring
+//does, returns length of the text, buff is not null terminated
+std::size_t formatNumber(lua_State * L, int index, char * buff);
+
+//gets each finished line of printed values, data is passed along untouched
+typedef void (*PrintedLineFunc)(const std::string& line, void * data);
+
+//prints values like tostring does, except tables, which are printed with
+//their' contents one entry per line and indented, down to maxdepth levels,
+//at most maxitems entries of each, and tables that contain themselves are
+//printed as <cycle>, once maxbytes were printed it prints ... and stops, but
+//strings passed to print itself are always printed whole and not counted, each
+//line goes to the line func as soon as it's done so output is never gathered
+//into one big string, only raw access is used so no metamethods are called
+
+class PrettyPrinter
+{
+public:
+    PrettyPrinter(lua_State * L, PrintedLineFunc linefunc, void * data,
+                  std::size_t maxdepth, std::size_t maxitems, std::size_t maxbytes);
+
+    //print value at index, strings are printed as they are, not quoted
+    void print(int index);
+
+    //print 'key = value' for key and value at given indices, strings quoted
+    void printEntry(int key, int value);
+
+    //print a separator between values
+    void printSeparator();
+
+    //pass the last unfinished line to line func, if there is one
+    void finish();
+
+private:
+    void printValue(int index, std::size_t depth, bool quote);
+    void printTable(int index, std::size_t depth);
+    void printKey(int index);
+    void printQuoted(const char * str, std::size_t len);
+    void put(const char * str, std::size_t len);
+    void put(const char * str);
+    void newLine();
+
+    lua_State * L; //lua state we print values of
+    PrintedLineFunc m_linefunc; //func that gets finished lines
+    void * m_data; //data for line func
+    const std::size_t m_maxdepth; //how deep into tables we go
+    const std::size_t m_maxitems; //how many entries of each table we print
+    const std::size_t m_maxbytes; //how many bytes we print in total
+    std::size_t m_bytes; //how many bytes we printed so far
+    bool m_full; //did we print maxbytes already
+    std::size_t m_indent; //how deep in tables we are
+    std::string m_line; //current unfinished line
+    std::vector<const void*> m_path; //tables we are inside of, for spotting cycles
+
+};
+
+} //priv
+} //blua
+
+#endif	/* LUAPRETTYPRINT_HPP */
+
@@ -0,0 +1,516 @@
+#include <LuaConsole/LuaProfiler.hpp>
+#include <LuaConsole/LuaCommandStats.hpp>
+#include <LuaConsole/LuaHeader.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#include <errno.h>
+#include <signal.h>
+#endif
+
+namespace blua {
+namespace priv {
+
+//instructions between hook calls without timer thread, hook only reads the clock most of the time
+const int kHookCount = 1000;
+
+//shortest interval between samples, so the timer thread never spins
+const double kMinInterval = 1e-4;
+
+//deepest stack level walked per sample, deeper frames are not counted
+const int kMaxSampleDepth = 64;
+
+//deepest level of call tree shown and smallest share of samples a node needs to be shown
+const std::size_t kMaxTreeDepth = 16u;
+const double kMinTreeShare = 0.01;
+
+//address of this is the registry key of the light userdata of running profiler
+static char profilerKey;
+
+static void profilerHook(lua_State * L, lua_Debug * ar)
+{
+    (void)ar;
+    lua_pushlightuserdata(L, &profilerKey);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    Profiler * profiler = static_cast<Profiler*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+
+    //a coroutine made while it was armed can still have the hook after stop
+    if(profiler)
+        profiler->sample(L);
+    else
+        lua_sethook(L, 0x0, 0, 0);
+}
+
+//set (or with null clear) running profiler in registry of L
+static void setRegistryProfiler(lua_State * L, Profiler * profiler)
+{
+    lua_pushlightuserdata(L, &profilerKey);
+    if(profiler)
+        lua_pushlightuserdata(L, profiler);
+    else
+        lua_pushnil(L);
+
+    lua_rawset(L, LUA_REGISTRYINDEX);
+}
+
+#ifndef _WIN32
+
+//profiler the SIGPROF handler arms the hook for, one per process as the handler is
+static Profiler * volatile theProfiler = 0x0;
+
+static void profilerSignal(int sig)
+{
+    (void)sig;
+    Profiler * profiler = theProfiler;
+    if(profiler)
+        profiler->arm();
+}
+
+#endif //_WIN32
+
+//sort indices by samples, most first
+class BySamples
+{
+public:
+    BySamples(const std::vector<std::size_t>& samples) : m_samples(samples) { }
+
+    bool operator()(std::size_t a, std::size_t b) const
+    {
+        return m_samples[a] > m_samples[b];
+    }
+
+private:
+    const std::vector<std::size_t>& m_samples;
+
+};
+
+Profiler::Profiler() :
+m_running(false),
+m_interval(0.0),
+m_next(0.0),
+m_started(0.0),
+m_elapsed(0.0),
+m_samples(0u),
+m_stamp(0u),
+m_foreign(0)
+#ifndef _WIN32
+,
+m_L(0x0),
+m_pending(0),
+m_quit(false)
+#endif
+{
+#ifndef _WIN32
+    pthread_mutex_init(&m_mutex, 0x0);
+    pthread_cond_init(&m_cond, 0x0);
+#endif
+}
+
+Profiler::~Profiler()
+{
+#ifndef _WIN32
+    if(m_running)
+        stopThread();
+
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
+#endif
+}
+
+bool Profiler::start(lua_State * L, double interval)
+{
+    if(lua_gethook(L) && lua_gethook(L) != &profilerHook)
+        return false;
+
+    stop(L);
+    m_functions.clear();
+    m_functionids.clear();
+    m_lines.clear();
+    m_nodes.assign(1u, Node());
+    m_nodes[0].Function = 0u;
+    m_nodes[0].Child = 0u;
+    m_nodes[0].Sibling = 0u;
+    m_nodes[0].Self = 0u;
+    m_nodes[0].Total = 0u;
+    m_samples = 0u;
+    m_stamp = 0u;
+    m_elapsed = 0.0;
+    m_interval = std::max(interval, kMinInterval);
+    m_started = getWallSeconds();
+    m_next = m_started + m_interval;
+    m_foreign = 0;
+
+#ifdef _WIN32
+    setRegistryProfiler(L, this);
+    lua_sethook(L, &profilerHook, LUA_MASKCOUNT, kHookCount);
+#else
+    //don't take SIGPROF over from another profiler, ours or not
+    if(sigaction(SIGPROF, 0x0, &m_oldaction) != 0 || (m_oldaction.sa_flags & SA_SIGINFO) ||
+       (m_oldaction.sa_handler != SIG_DFL && m_oldaction.sa_handler != SIG_IGN))
+        return false;
+
+    m_L = L;
+    m_luathread = pthread_self();
+    m_quit = false;
+    m_pending = 0;
+    setRegistryProfiler(L, this);
+    theProfiler = this;
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &profilerSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if(sigaction(SIGPROF, &action, 0x0) != 0 ||
+       pthread_create(&m_thread, 0x0, &Profiler::threadMain, this) != 0)
+    {
+        sigaction(SIGPROF, &m_oldaction, 0x0);
+        theProfiler = 0x0;
+        setRegistryProfiler(L, 0x0);
+        return false;
+    }
+#endif
+
+    m_running = true;
+    return true;
+}
+
+void Profiler::stop(lua_State * L)
+{
+    if(!m_running)
+        return;
+
+    m_running = false;
+    m_elapsed = getWallSeconds() - m_started;
+
+#ifndef _WIN32
+    //signals must be over before unhooking or the handler could arm it again
+    stopThread();
+#endif
+
+    setRegistryProfiler(L, 0x0);
+    if(lua_gethook(L) == &profilerHook)
+        lua_sethook(L, 0x0, 0, 0);
+}
+
+bool Profiler::isRunning() const
+{
+    return m_running && !m_foreign;
+}
+
+void Profiler::sample(lua_State * L)
+{
+#ifdef _WIN32
+    const double now = getWallSeconds();
+    if(now < m_next)
+        return;
+
+    //intervals that passed in a long C call all count for this sample
+    const std::size_t weight = 1u + static_cast<std::size_t>((now - m_next) / m_interval);
+    m_next = now + m_interval;
+    takeSample(L, weight);
+#else
+    //hook fires once per arming, in coroutines that inherited it too, only
+    //one of them takes the sample and each one disarms itself, if the
+    //handler armed it many times before it fired (state was in a long C call
+    //or running a coroutine) then the sample counts that many times, the
+    //signal is blocked so the handler can't arm it again in between
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    const std::size_t weight = m_pending;
+    m_pending = 0;
+    if(lua_gethook(L) == &profilerHook)
+        lua_sethook(L, 0x0, 0, 0);
+
+    pthread_sigmask(SIG_SETMASK, &old, 0x0);
+    if(weight > 0u)
+        takeSample(L, weight);
+#endif
+}
+
+void Profiler::arm()
+{
+#ifndef _WIN32
+    //this runs on the thread of the state, between two of its' instructions
+    //or outside of lua, so it's the same as SIGINT handler of lua.c does
+    const lua_Hook hook = lua_gethook(m_L);
+    if(m_foreign || (hook && hook != &profilerHook))
+    {
+        m_foreign = 1;
+        return;
+    }
+
+    ++m_pending;
+    lua_sethook(m_L, &profilerHook, LUA_MASKCOUNT, 1);
+#endif
+}
+
+void Profiler::takeSample(lua_State * L, std::size_t weight)
+{
+    m_samples += weight;
+    ++m_stamp;
+
+    //walk from level 0, the function that was running, outwards
+    m_stack.clear();
+    lua_Debug ar;
+    int topline = -1;
+    for(int level = 0; level < kMaxSampleDepth && lua_getstack(L, level, &ar); ++level)
+    {
+        lua_getinfo(L, "Sln", &ar);
+        if(level == 0)
+            topline = ar.currentline;
+
+        m_stack.push_back(internFunction(ar.short_src, ar.linedefined, ar.what, ar.name));
+    }
+
+    m_nodes[0].Total += weight;
+    if(m_stack.empty())
+        return;
+
+    m_functions[m_stack[0]].Self += weight;
+    m_lines[LineKey(m_stack[0], topline)] += weight;
+
+    //recursive functions are on stack many times but count once per sample
+    //and direct recursion stays in one node to keep the tree small
+    unsigned node = 0u;
+    for(std::size_t i = m_stack.size(); i > 0u; --i)
+    {
+        Function& function = m_functions[m_stack[i - 1u]];
+        if(function.Stamp != m_stamp)
+        {
+            function.Stamp = m_stamp;
+            function.Total += weight;
+        }
+
+        if(node != 0u && m_nodes[node].Function == m_stack[i - 1u])
+            continue;
+
+        node = findChild(node, m_stack[i - 1u]);
+        m_nodes[node].Total += weight;
+    }
+    m_nodes[node].Self += weight;
+}
+
+unsigned Profiler::internFunction(const char * src, int line, const char * what, const char * name)
+{
+    //C functions have no source line so tell them apart by name
+    char buff[32];
+    const bool isc = what[0] == 'C';
+    std::sprintf(buff, ":%d", line);
+    m_key.assign(src);
+    if(isc)
+        m_key.append(":").append(name?name:"?");
+    else
+        m_key.append(buff);
+
+    std::map<std::string, unsigned>::iterator it = m_functionids.find(m_key);
+    if(it != m_functionids.end())
+        return it->second;
+
+    Function function;
+    if(name)
+        function.Name = name;
+    else if(what[0] == 'm')
+        function.Name = "main chunk";
+    else
+        function.Name = "?";
+
+    function.Where = isc?std::string("[C]"):(src + std::string(buff));
+    function.Self = 0u;
+    function.Total = 0u;
+    function.Stamp = 0u;
+    m_functions.push_back(function);
+    m_functionids.insert(std::make_pair(m_key, m_functions.size() - 1u));
+    return m_functions.size() - 1u;
+}
+
+unsigned Profiler::findChild(unsigned node, unsigned function)
+{
+    unsigned child = m_nodes[node].Child;
+    while(child != 0u)
+    {
+        if(m_nodes[child].Function == function)
+            return child;
+
+        child = m_nodes[child].Sibling;
+    }
+
+    Node added;
+    added.Function = function;
+    added.Child = 0u;
+    added.Sibling = m_nodes[node].Child;
+    added.Self = 0u;
+    added.Total = 0u;
+    m_nodes.push_back(added);
+    m_nodes[node].Child = m_nodes.size() - 1u;
+    return m_nodes.size() - 1u;
+}
+
+std::string Profiler::formatFunction(unsigned function) const
+{
+    return m_functions[function].Name + " (" + m_functions[function].Where + ")";
+}
+
+void Profiler::report(std::size_t count, std::vector<std::string>& rows) const
+{
+    char buff[200];
+    const double elapsed = m_running?(getWallSeconds() - m_started):m_elapsed;
+    const char * state = m_foreign?", stopped by a debug hook set after start":(m_running?", still running":"");
+    std::sprintf(buff, "%lu samples in %.2f s, one per %g ms%s", static_cast<unsigned long>(m_samples),
+                 elapsed, m_interval * 1e3, state);
+    rows.push_back(buff);
+    if(m_samples == 0u)
+        return;
+
+    const double percent = 100.0 / m_samples;
+    std::vector<std::size_t> order(m_functions.size());
+    std::vector<std::size_t> samples(m_functions.size());
+    for(std::size_t i = 0u; i < m_functions.size(); ++i)
+        order[i] = i;
+
+    //top functions by self samples and then by total samples
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        for(std::size_t i = 0u; i < m_functions.size(); ++i)
+            samples[i] = pass?m_functions[i].Total:m_functions[i].Self;
+
+        std::stable_sort(order.begin(), order.end(), BySamples(samples));
+        rows.push_back(pass?"  total%   self%  function":"   self%  total%  function");
+        for(std::size_t i = 0u; i < order.size() && i < count && samples[order[i]] > 0u; ++i)
+        {
+            const Function& function = m_functions[order[i]];
+            const double first = (pass?function.Total:function.Self) * percent;
+            const double second = (pass?function.Self:function.Total) * percent;
+            std::sprintf(buff, "  %5.1f%%  %5.1f%%  ", first, second);
+            rows.push_back(buff + formatFunction(order[i]));
+        }
+    }
+
+    //top lines by self samples
+    std::vector<LineKey> lines;
+    samples.clear();
+    for(std::map<LineKey, std::size_t>::const_iterator it = m_lines.begin(); it != m_lines.end(); ++it)
+    {
+        lines.push_back(it->first);
+        samples.push_back(it->second);
+    }
+
+    order.resize(lines.size());
+    for(std::size_t i = 0u; i < lines.size(); ++i)
+        order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), BySamples(samples));
+    rows.push_back("   self%  line");
+    for(std::size_t i = 0u; i < order.size() && i < count; ++i)
+    {
+        const LineKey& line = lines[order[i]];
+        const Function& function = m_functions[line.first];
+        //where of lua functions is source:linedefined, C ones have no lines
+        const std::string src = function.Where.substr(0u, function.Where.rfind(':'));
+        const int len = std::sprintf(buff, "  %5.1f%%  ", samples[order[i]] * percent);
+        if(line.second > 0)
+            std::sprintf(buff + len, ":%d in ", line.second);
+        else
+            std::sprintf(buff + len, " in ");
+
+        rows.push_back(std::string(buff, len) + src + (buff + len) + function.Name);
+    }
+
+    rows.push_back("  total%   self%  call tree");
+    reportTree(0u, 0u, rows);
+}
+
+void Profiler::reportTree(unsigned node, std::size_t depth, std::vector<std::string>& rows) const
+{
+    //children are in no particular order so pick them biggest first
+    std::vector<unsigned> children;
+    std::vector<std::size_t> samples(m_nodes.size());
+    for(unsigned child = m_nodes[node].Child; child != 0u; child = m_nodes[child].Sibling)
+    {
+        if(m_nodes[child].Total >= m_samples * kMinTreeShare)
+            children.push_back(child);
+
+        samples[child] = m_nodes[child].Total;
+    }
+
+    std::stable_sort(children.begin(), children.end(), BySamples(samples));
+    const double percent = 100.0 / m_samples;
+    char buff[64];
+    for(std::size_t i = 0u; i < children.size(); ++i)
+    {
+        const Node& child = m_nodes[children[i]];
+        std::sprintf(buff, "  %5.1f%%  %5.1f%%  ", child.Total * percent, child.Self * percent);
+        rows.push_back(buff + std::string(depth * 2u, ' ') + formatFunction(child.Function));
+        if(depth + 1u < kMaxTreeDepth)
+            reportTree(children[i], depth + 1u, rows);
+    }
+}
+
+#ifndef _WIN32
+
+void * Profiler::threadMain(void * data)
+{
+    static_cast<Profiler*>(data)->run();
+    return 0x0;
+}
+
+void Profiler::run()
+{
+    pthread_mutex_lock(&m_mutex);
+    while(!m_quit)
+    {
+        //wait until interval passes or we get woken up to quit
+        struct timeval now;
+        gettimeofday(&now, 0x0);
+        const double until = now.tv_sec + now.tv_usec * 1e-6 + m_interval;
+        struct timespec deadline;
+        deadline.tv_sec = static_cast<time_t>(until);
+        deadline.tv_nsec = static_cast<long>((until - deadline.tv_sec) * 1e9);
+        int err = 0;
+        while(!m_quit && err != ETIMEDOUT)
+            err = pthread_cond_timedwait(&m_cond, &m_mutex, &deadline);
+
+        if(m_quit)
+            break;
+
+        //the state is only touched by its' own thread, in the handler
+        pthread_kill(m_luathread, SIGPROF);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void Profiler::stopThread()
+{
+    pthread_mutex_lock(&m_mutex);
+    m_quit = true;
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+    pthread_join(m_thread, 0x0);
+
+    //a signal sent right before thread quit could still be pending, take it
+    //before giving SIGPROF back, default action of it is to end the process
+    sigset_t set, old, pending;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    if(sigpending(&pending) == 0 && sigismember(&pending, SIGPROF))
+    {
+        int sig;
+        sigwait(&set, &sig);
+    }
+
+    sigaction(SIGPROF, &m_oldaction, 0x0);
+    theProfiler = 0x0;
+    pthread_sigmask(SIG_SETMASK, &old, 0x0);
+}
+
+#endif //_WIN32
+
+} //priv
+} //blua
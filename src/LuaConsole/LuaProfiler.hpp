@@ -0,0 +1,150 @@
+#ifndef LUAPROFILER_HPP
+#define	LUAPROFILER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <csignal>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+struct lua_State;
+
+namespace blua {
+namespace priv {
+
+//sampling profiler, once per interval a timer thread sends SIGPROF to the
+//thread that started it (the one that runs the state) and the handler arms a
+//count hook on the state, the same way lua.c and luajit.c do from their'
+//SIGINT handlers, so the state is only ever touched from its' own thread,
+//the hook fires on the next instruction, walks the stack with lua_getinfo
+//into a call tree and removes itself, so between samples there's no overhead
+//at all (any count hook set all the time costs about a quarter of speed,
+//since the vm checks it on every instruction), each function is interned
+//once by its' source and line and each tree node is a few ints so nothing is
+//allocated once all stacks have been seen
+//
+//a hook that's not ours (like one lua code set with debug.sethook) is never
+//replaced or removed, if the handler finds one then profiling ends there, as
+//the handler is process wide only one profiler runs at a time and it won't
+//start if someone else handles SIGPROF already, the handler is installed with
+//SA_RESTART but sleeps and waits of C code on the thread can still be cut
+//short with EINTR while it runs
+//
+//only lua code runs hooks so time in a long C call is sampled (with weight
+//of all intervals it took) on the line that made it once it returns, hook is
+//armed on the state given to start so time in a coroutine is sampled the
+//same way at the line that resumed it, and LuaJIT only runs hooks in the
+//interpreter, not in compiled traces
+//
+//Windows has no signals or timer thread here so the hook stays on and checks
+//the clock every 1000 instructions instead, that works the same but costs more
+
+class Profiler
+{
+public:
+    Profiler();
+
+    //stops the timer thread, owner must stop with the state before that
+    ~Profiler();
+
+    //start sampling L every interval seconds, clearing what was sampled
+    //before, returns false if L already has a hook that's not ours or if
+    //another profiler or someone else handles SIGPROF, this must be called
+    //from the thread that runs L
+    bool start(lua_State * L, double interval);
+
+    //stop sampling L, samples are kept for report
+    void stop(lua_State * L);
+
+    //check whether or not it's sampling, it's not once a hook that's not
+    //ours was found, even if stop wasn't called yet
+    bool isRunning() const;
+
+    //append rows of report of top count functions by self and by total
+    //samples, top count lines by self samples and the call tree to rows
+    void report(std::size_t count, std::vector<std::string>& rows) const;
+
+    //called by the hook, takes a sample if it's time for one
+    void sample(lua_State * L);
+
+    //called by SIGPROF handler on thread of the state, arms the hook unless
+    //the state has one that's not ours
+    void arm();
+
+private:
+    //delete copy and assignment to forbid copying (thread has our 'this')
+    Profiler(const Profiler& other);
+    Profiler& operator=(const Profiler& other);
+
+    class Function
+    {
+    public:
+        std::string Name; //name of the function in the first sample it was in
+        std::string Where; //source and line it was defined at
+        std::size_t Self; //samples it was on top of stack in
+        std::size_t Total; //samples it was anywhere on stack in
+        std::size_t Stamp; //last stack walk it was counted in, for recursion
+
+    };
+
+    //node of call tree, children are a linked list like in HistoryTrie
+    class Node
+    {
+    public:
+        unsigned Function; //index into m_functions
+        unsigned Child; //first child, 0 if none
+        unsigned Sibling; //next child of same parent, 0 if none
+        std::size_t Self;
+        std::size_t Total;
+
+    };
+
+    typedef std::pair<unsigned, int> LineKey;
+
+    void takeSample(lua_State * L, std::size_t weight);
+    unsigned internFunction(const char * src, int line, const char * what, const char * name);
+    unsigned findChild(unsigned node, unsigned function);
+    void reportTree(unsigned node, std::size_t depth, std::vector<std::string>& rows) const;
+    std::string formatFunction(unsigned function) const;
+
+    bool m_running; //are we sampling now
+    double m_interval; //seconds between samples
+    double m_next; //when to take next sample, if there's no timer thread
+    double m_started; //when sampling started
+    double m_elapsed; //how long it sampled, when stopped
+    std::size_t m_samples; //how many samples were taken, with weights
+    std::size_t m_stamp; //how many stack walks were done
+    std::vector<Function> m_functions; //all functions seen in samples
+    std::map<std::string, unsigned> m_functionids; //indices of functions by source and line
+    std::vector<Node> m_nodes; //the call tree, first one is the root
+    std::map<LineKey, std::size_t> m_lines; //self samples by function and line
+    std::vector<unsigned> m_stack; //reused, functions of current sample, innermost first
+    std::string m_key; //reused, key of function being interned
+    volatile std::sig_atomic_t m_foreign; //was a hook that's not ours found
+
+#ifndef _WIN32
+    static void * threadMain(void * data);
+    void run();
+    void stopThread();
+
+    lua_State * m_L; //state the handler arms hook of
+    pthread_t m_luathread; //thread that runs the state, gets the signals
+    struct sigaction m_oldaction; //SIGPROF action from before start
+    volatile std::sig_atomic_t m_pending; //how many times handler armed the hook since it last fired
+    pthread_t m_thread; //the timer thread
+    pthread_mutex_t m_mutex; //guards m_quit
+    pthread_cond_t m_cond; //signaled to wake the thread up on stop
+    bool m_quit; //should the thread end
+#endif
+
+};
+
+} //priv
+} //blua
+
+#endif	/* LUAPROFILER_HPP */
+
@@ -71,10 +71,12 @@ void LuaSFMLConsoleInput::handleKeyEvent(sf::Event event)
             m_model->moveCursor(-1);
             break;
         case sf::Keyboard::Right:
-            m_model->moveCursor(1);
+            if(!m_model->acceptSuggestion())
+                m_model->moveCursor(1);
             break;
         case sf::Keyboard::End:
-            m_model->moveCursor(kCursorEnd);
+            if(!m_model->acceptSuggestion())
+                m_model->moveCursor(kCursorEnd);
             break;
         case sf::Keyboard::Home:
             m_model->moveCursor(kCursorHome);
@@ -88,6 +90,12 @@ void LuaSFMLConsoleInput::handleKeyEvent(sf::Event event)
         case sf::Keyboard::Tab:
             m_model->tryComplete();
             break;
+        case sf::Keyboard::Escape:
+            m_model->stopHistorySearch(false);
+            break;
+        case sf::Keyboard::F3:
+            m_model->jumpToMatch(event.key.shift?1:-1);
+            break;
         default:
             //TODO:optionally do not consume all keys?
             break;
@@ -124,6 +132,12 @@ void LuaSFMLConsoleInput::handleCtrlKeyEvent(sf::Event event)
         case sf::Keyboard::PageDown:
             m_model->scrollLines(21);
             break;
+        case sf::Keyboard::R:
+            m_model->searchHistory();
+            break;
+        case sf::Keyboard::G:
+            m_model->stopHistorySearch(false);
+            break;
         default:
             //TODO:optionally do not consume all keys? (as above)
             break;
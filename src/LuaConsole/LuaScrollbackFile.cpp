@@ -0,0 +1,349 @@
+#include <LuaConsole/LuaScrollbackFile.hpp>
+#include <LuaConsole/LuaColdScrollback.hpp>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#endif
+
+namespace blua {
+namespace priv {
+
+#ifdef _WIN32
+
+ScrollbackFile::ScrollbackFile() :
+m_lineno(0u) { }
+
+ScrollbackFile::~ScrollbackFile() { }
+
+bool ScrollbackFile::open(const std::string&, std::size_t)
+{
+    return false;
+}
+
+void ScrollbackFile::close() { }
+
+bool ScrollbackFile::isOpen() const
+{
+    return false;
+}
+
+std::size_t ScrollbackFile::getArchivedCount() const
+{
+    return 0u;
+}
+
+const ColoredLine& ScrollbackFile::getArchivedLine(std::size_t) const
+{
+    return m_line;
+}
+
+void ScrollbackFile::dropArchived() { }
+
+void ScrollbackFile::append(const ColoredLine&) { }
+
+void ScrollbackFile::flush(bool) { }
+
+#else //_WIN32
+
+//each file starts with its' magic, so a wrong or old file is never misread
+const char * const kDataMagic = "BLASCRB1";
+const char * const kIndexMagic = "BLASCRI1";
+const std::size_t kMagicSize = 8u;
+
+//size of single offset in index file
+const std::size_t kOffsetSize = 8u;
+
+//queued lines are written once there's this many bytes of them, unless forced
+const std::size_t kFlushBytes = 64u * 1024u;
+
+static off_t getFileSize(int fd)
+{
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+        return 0;
+
+    return st.st_size;
+}
+
+//write all size bytes from buff, returns false on any error
+static bool writeAll(int fd, const char * buff, std::size_t size)
+{
+    while(size > 0u)
+    {
+        const ssize_t put = write(fd, buff, size);
+        if(put < 0 && errno == EINTR)
+            continue;
+
+        if(put <= 0)
+            return false;
+
+        buff += put;
+        size -= put;
+    }
+    return true;
+}
+
+static void putOffset(std::string& out, std::size_t offset)
+{
+    for(unsigned b = 0u; b < kOffsetSize; ++b)
+    {
+        out += static_cast<char>(offset & 0xffu);
+        offset >>= 8;
+    }
+}
+
+//check file starts with magic, if it's empty or doesn't then clear it and write magic in
+static bool checkMagic(int fd, const char * magic)
+{
+    char buff[kMagicSize];
+    if(pread(fd, buff, kMagicSize, 0) == static_cast<ssize_t>(kMagicSize) &&
+       std::memcmp(buff, magic, kMagicSize) == 0)
+        return true;
+
+    return ftruncate(fd, 0) == 0 && writeAll(fd, magic, kMagicSize);
+}
+
+static void * mapFile(int fd, std::size_t size)
+{
+    void * ret = mmap(0x0, size, PROT_READ, MAP_SHARED, fd, 0);
+    return (ret == MAP_FAILED)?0x0:ret;
+}
+
+ScrollbackFile::ScrollbackFile() :
+m_datafd(-1),
+m_indexfd(-1),
+m_datamap(0x0),
+m_datamapsize(0u),
+m_indexmap(0x0),
+m_indexmapsize(0u),
+m_archived(0u),
+m_dataend(0),
+m_lineno(0u) { }
+
+ScrollbackFile::~ScrollbackFile()
+{
+    close();
+}
+
+bool ScrollbackFile::open(const std::string& filename, std::size_t keeplines)
+{
+    close();
+    if(!openFiles(filename))
+        return false;
+
+    //if trimming fails the files stay as they were, which is still fine
+    if(keeplines != 0u && m_archived > keeplines && trim(filename, keeplines))
+    {
+        closeFiles();
+        return openFiles(filename);
+    }
+    return true;
+}
+
+void ScrollbackFile::close()
+{
+    flush();
+    closeFiles();
+}
+
+bool ScrollbackFile::isOpen() const
+{
+    return m_datafd >= 0;
+}
+
+std::size_t ScrollbackFile::getArchivedCount() const
+{
+    return m_archived;
+}
+
+const ColoredLine& ScrollbackFile::getArchivedLine(std::size_t line) const
+{
+    //don't parse the same line again if it's asked for again
+    if(line == m_lineno)
+        return m_line;
+
+    //someone else could have truncated the files since we mapped them, and
+    //touching a mapped page that's past the end now raises SIGBUS, so never
+    //read past what the files hold right now
+    m_lineno = line;
+    const std::size_t datasize = std::min<std::size_t>(m_datamapsize, getFileSize(m_datafd));
+    const std::size_t indexsize = std::min<std::size_t>(m_indexmapsize, getFileSize(m_indexfd));
+    const bool indexed = line < m_archived && kMagicSize + (line + 1u) * kOffsetSize <= indexsize;
+    std::size_t pos = indexed?getOffset(line):0u;
+    if(pos < kMagicSize || !parseColoredLine(static_cast<const char*>(m_datamap), datasize, pos, m_line))
+        m_line = ColoredLine();
+
+    return m_line;
+}
+
+void ScrollbackFile::dropArchived()
+{
+    if(m_datamap)
+        munmap(m_datamap, m_datamapsize);
+
+    if(m_indexmap)
+        munmap(m_indexmap, m_indexmapsize);
+
+    m_datamap = m_indexmap = 0x0;
+    m_datamapsize = m_indexmapsize = 0u;
+    m_archived = 0u;
+    m_lineno = 0u;
+    m_line = ColoredLine();
+}
+
+void ScrollbackFile::append(const ColoredLine& line)
+{
+    if(m_datafd < 0)
+        return;
+
+    const std::size_t size = m_pendingdata.size();
+    putOffset(m_pendingindex, static_cast<std::size_t>(m_dataend));
+    serializeColoredLine(m_pendingdata, line);
+    m_dataend += m_pendingdata.size() - size;
+}
+
+void ScrollbackFile::flush(bool force)
+{
+    if(m_datafd < 0 || m_pendingdata.empty())
+        return;
+
+    if(!force && m_pendingdata.size() < kFlushBytes)
+        return;
+
+    //data goes first so index never points at what's not there, if data
+    //didn't get written then don't write index either and go on from real end
+    if(writeAll(m_datafd, m_pendingdata.data(), m_pendingdata.size()))
+        writeAll(m_indexfd, m_pendingindex.data(), m_pendingindex.size());
+    else
+        m_dataend = getFileSize(m_datafd);
+
+    m_pendingdata.clear();
+    m_pendingindex.clear();
+}
+
+bool ScrollbackFile::openFiles(const std::string& filename)
+{
+    m_datafd = ::open(filename.c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+    m_indexfd = ::open((filename + ".idx").c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+    if(m_datafd < 0 || m_indexfd < 0 || !checkMagic(m_datafd, kDataMagic) ||
+       !checkMagic(m_indexfd, kIndexMagic))
+    {
+        closeFiles();
+        return false;
+    }
+
+    //a crash could leave half an offset at the end, or offsets of lines that
+    //never got written if it wasn't ours, so drop these, without looking at
+    //any other line
+    const off_t datasize = getFileSize(m_datafd);
+    const off_t indexsize = getFileSize(m_indexfd);
+    m_datamapsize = datasize;
+    m_indexmapsize = indexsize;
+    m_datamap = mapFile(m_datafd, m_datamapsize);
+    m_indexmap = mapFile(m_indexfd, m_indexmapsize);
+    if(!m_datamap || !m_indexmap)
+    {
+        closeFiles();
+        return false;
+    }
+
+    m_archived = (indexsize - kMagicSize) / kOffsetSize;
+    while(m_archived > 0u && getOffset(m_archived - 1u) >= static_cast<std::size_t>(datasize))
+        --m_archived;
+
+    const off_t goodsize = kMagicSize + m_archived * kOffsetSize;
+    if(goodsize != indexsize && ftruncate(m_indexfd, goodsize) != 0)
+    {
+        closeFiles();
+        return false;
+    }
+
+    m_dataend = datasize;
+    m_lineno = m_archived; //nothing cached yet
+    return true;
+}
+
+void ScrollbackFile::closeFiles()
+{
+    dropArchived();
+    if(m_datafd >= 0)
+        ::close(m_datafd);
+
+    if(m_indexfd >= 0)
+        ::close(m_indexfd);
+
+    m_datafd = m_indexfd = -1;
+    m_pendingdata.clear();
+    m_pendingindex.clear();
+}
+
+bool ScrollbackFile::trim(const std::string& filename, std::size_t keeplines)
+{
+    //don't read the maps if someone truncated the files since we mapped them
+    if(static_cast<std::size_t>(getFileSize(m_datafd)) < m_datamapsize ||
+       static_cast<std::size_t>(getFileSize(m_indexfd)) < m_indexmapsize)
+        return false;
+
+    //last keeplines lines are one contiguous piece of data file, so copy it
+    //as it is and just move the offsets back by how much was cut off
+    const std::size_t first = m_archived - keeplines;
+    const std::size_t cut = getOffset(first) - kMagicSize;
+
+    std::string index(kIndexMagic, kMagicSize);
+    for(std::size_t i = first; i < m_archived; ++i)
+        putOffset(index, getOffset(i) - cut);
+
+    char pid[32];
+    std::sprintf(pid, ".tmp.%ld", static_cast<long>(getpid()));
+    const std::string dataname = filename + pid;
+    const std::string indexname = filename + ".idx" + pid;
+    const int datatmp = ::open(dataname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    const int indextmp = ::open(indexname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    const char * data = static_cast<const char*>(m_datamap);
+    const bool ok = datatmp >= 0 && indextmp >= 0 &&
+            writeAll(datatmp, kDataMagic, kMagicSize) &&
+            writeAll(datatmp, data + kMagicSize + cut, m_datamapsize - kMagicSize - cut) &&
+            writeAll(indextmp, index.data(), index.size()) &&
+            fsync(datatmp) == 0 && fsync(indextmp) == 0;
+
+    if(datatmp >= 0)
+        ::close(datatmp);
+
+    if(indextmp >= 0)
+        ::close(indextmp);
+
+    //a crash between the renames leaves new data with old index, lines come
+    //out broken then but never read past the end, that's fine for scrollback
+    if(!ok || rename(dataname.c_str(), filename.c_str()) != 0 ||
+       rename(indexname.c_str(), (filename + ".idx").c_str()) != 0)
+    {
+        unlink(dataname.c_str());
+        unlink(indexname.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::size_t ScrollbackFile::getOffset(std::size_t line) const
+{
+    //bytes past what size_t holds have to be 0 anyway since file is mapped
+    const unsigned char * p = static_cast<const unsigned char*>(m_indexmap) + kMagicSize + line * kOffsetSize;
+    std::size_t ret = 0u;
+    for(unsigned b = std::min<std::size_t>(kOffsetSize, sizeof(ret)); b > 0u; --b)
+        ret = (ret << 8) | p[b - 1u];
+
+    return ret;
+}
+
+#endif //_WIN32
+
+} //priv
+} //blua
@@ -0,0 +1,91 @@
+#ifndef LUASCROLLBACKFILE_HPP
+#define	LUASCROLLBACKFILE_HPP
+
+#include <LuaConsole/LuaConsoleModel.hpp>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+namespace blua {
+namespace priv {
+
+//wide lines of scrollback persisted across runs, in two files: the data file
+//holds lines one after another, serialized with serializeColoredLine, and the
+//index file (data file name + ".idx") holds 8 byte little endian offset of
+//each line in the data file, both start with an 8 byte magic, lines are
+//queued as they are echoed and appended to both in bulk, data first, so an
+//index entry never points past what's written, on open both files are memory mapped and lines
+//that were in them (the archive) are parsed one by one only when asked for,
+//so opening costs the same no matter how many lines there are
+//
+//this is POSIX only, on Windows open always fails and nothing else happens
+
+class ScrollbackFile
+{
+public:
+    ScrollbackFile();
+
+    //closes, see close
+    ~ScrollbackFile();
+
+    //open (or create) the files and map lines already in them as the archive,
+    //if there are over keeplines lines then only the last keeplines are kept,
+    //which is done by copying them to new files and renaming these over
+    bool open(const std::string& filename, std::size_t keeplines);
+
+    //write out queued lines, unmap the archive and close the files
+    void close();
+
+    //check if files are open
+    bool isOpen() const;
+
+    //get count of lines in the archive
+    std::size_t getArchivedCount() const;
+
+    //get line of the archive, broken lines come back empty
+    const ColoredLine& getArchivedLine(std::size_t line) const;
+
+    //forget the archive, the lines stay in the files
+    void dropArchived();
+
+    //queue line to be appended to the files
+    void append(const ColoredLine& line);
+
+    //write queued lines to the files, unless force is false and there are
+    //less than 64 KB of them, so echoing a line doesn't cost two syscalls
+    void flush(bool force = true);
+
+private:
+    //delete copy and assignment to forbid copying (we own descriptors and maps)
+    ScrollbackFile(const ScrollbackFile& other);
+    ScrollbackFile& operator=(const ScrollbackFile& other);
+
+#ifndef _WIN32
+    bool openFiles(const std::string& filename);
+    void closeFiles();
+    bool trim(const std::string& filename, std::size_t keeplines);
+    std::size_t getOffset(std::size_t line) const;
+
+    int m_datafd; //descriptor of data file, -1 if closed
+    int m_indexfd; //descriptor of index file, -1 if closed
+    void * m_datamap; //mapping of the data file as it was on open, null if none
+    std::size_t m_datamapsize; //size of data mapping
+    void * m_indexmap; //mapping of the index file as it was on open, null if none
+    std::size_t m_indexmapsize; //size of index mapping
+    std::size_t m_archived; //count of lines in the archive
+    off_t m_dataend; //size of data file, counting queued lines too
+    std::string m_pendingdata; //queued lines
+    std::string m_pendingindex; //queued offsets of queued lines
+#endif
+
+    mutable ColoredLine m_line; //last archived line asked for
+    mutable std::size_t m_lineno; //number of line in m_line, past archive if none
+
+};
+
+} //priv
+} //blua
+
+#endif	/* LUASCROLLBACKFILE_HPP */
+
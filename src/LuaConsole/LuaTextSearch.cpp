@@ -0,0 +1,56 @@
+#include <LuaConsole/LuaTextSearch.hpp>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace blua {
+namespace priv {
+
+std::size_t findSubstring(const char * haystack, std::size_t haylen, const char * needle, std::size_t needlelen)
+{
+    if(needlelen == 0u)
+        return 0u;
+
+    if(needlelen > haylen)
+        return kNoMatch;
+
+    std::size_t i = 0u;
+
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needlelen - 1u]);
+
+    //block at i checks starts i to i + 15, so last chars go up to i + needlelen + 14
+    for(; i + needlelen + 15u <= haylen; i += 16u)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + needlelen - 1u));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+
+        for(unsigned bit = 0u; mask; ++bit, mask >>= 1)
+            if((mask & 1u) && 0 == std::memcmp(haystack + i + bit, needle, needlelen))
+                return i + bit;
+    }
+#endif //__SSE2__
+
+    //tail (or everything without SSE2), jump between occurences of first char
+    const std::size_t laststart = haylen - needlelen;
+    while(i <= laststart)
+    {
+        const void * found = std::memchr(haystack + i, needle[0], laststart - i + 1u);
+        if(!found)
+            return kNoMatch;
+
+        i = static_cast<const char*>(found) - haystack;
+        if(0 == std::memcmp(haystack + i, needle, needlelen))
+            return i;
+
+        ++i;
+    }
+    return kNoMatch;
+}
+
+} //priv
+} //blua
@@ -0,0 +1,22 @@
+#ifndef LUATEXTSEARCH_HPP
+#define	LUATEXTSEARCH_HPP
+
+#include <cstddef>
+
+namespace blua {
+namespace priv {
+
+//value returned by findSubstring when there is no match
+const std::size_t kNoMatch = static_cast<std::size_t>(-1);
+
+//find first occurence of needle in haystack, returns its' offset or kNoMatch
+//with SSE2 this checks 16 positions at once by comparing the first and last
+//char of needle against the haystack and only does a full compare where both
+//match, without SSE2 it uses memchr to find the first char (usually SIMD too)
+std::size_t findSubstring(const char * haystack, std::size_t haylen, const char * needle, std::size_t needlelen);
+
+} //priv
+} //blua
+
+#endif	/* LUATEXTSEARCH_HPP */
+